@@ -0,0 +1,620 @@
+#include <SDL.h>
+#include <SDL_image.h>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#if defined(__SSE2__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+using namespace std;
+
+//Cada leccion se incluye en su propio namespace para medir su codigo tal cual,
+//sin copiarlo. Todas las cabeceras que usan ya estan incluidas arriba:
+#define LESSON_NO_MAIN
+namespace lesson38 {
+#include "lesson38.cpp"
+}
+namespace lesson39 {
+#include "lesson39.cpp"
+}
+namespace lesson41 {
+#include "lesson41.cpp"
+}
+namespace lesson42 {
+#include "lesson42.cpp"
+}
+namespace lesson44 {
+#include "lesson44.cpp"
+}
+
+//Benchmarks de los subsistemas de las lecciones (tiles, particulas, colisiones,
+//texto, subida de texturas y puntos). Corre sin pantalla con el driver dummy y el
+//renderer software, y escribe una linea JSON por caso y tamano. Usa los assets de
+//las lecciones, asi que se lanza desde la raiz del repositorio:
+//  benchmark [--iterations N] [--warmup N] [--filter nombre]
+
+const int SCREEN_WIDTH = 640;
+const int SCREEN_HEIGHT = 480;
+
+const int DEFAULT_ITERATIONS = 100;
+const int DEFAULT_WARMUP = 10;
+
+SDL_Window *window;
+SDL_Renderer *renderer;
+
+//Mapa de la leccion 39, lo usan los casos de tiles y de colisiones:
+lesson39::Tile *lesson39Map[lesson39::TOTAL_TILES];
+
+//Un caso de benchmark: setup() prepara el problema para un tamano, run() es
+//lo que se mide en cada iteracion y teardown() libera lo de setup():
+class Benchmark {
+    public:
+        virtual ~Benchmark() {}
+
+        virtual string getName() = 0;
+        //Que se escala (tiles, particles...):
+        virtual string getUnit() = 0;
+        virtual vector<int> getSizes() = 0;
+
+        virtual bool setup(int size) = 0;
+        virtual void run() = 0;
+        virtual void teardown() = 0;
+
+        //Los casos que no dibujan nada miden solo run(), sin limpiar ni presentar:
+        virtual bool drawsFrame() { return true; }
+};
+
+//Pulsa o suelta en un punto de las lecciones las flechas de una direccion (0-7),
+//asi los puntos se mueven con su propio handleEvent:
+template<typename DotType>
+void sendDirection(DotType &dot, int direction, bool pressed) {
+    const SDL_Keycode horizontal[8] = {SDLK_RIGHT, SDLK_RIGHT, 0, SDLK_LEFT, SDLK_LEFT, SDLK_LEFT, 0, SDLK_RIGHT};
+    const SDL_Keycode vertical[8] = {0, SDLK_DOWN, SDLK_DOWN, SDLK_DOWN, 0, SDLK_UP, SDLK_UP, SDLK_UP};
+    const SDL_Keycode keys[2] = {horizontal[direction % 8], vertical[direction % 8]};
+
+    SDL_Event e;
+    memset(&e, 0, sizeof(e));
+    e.type = pressed ? SDL_KEYDOWN : SDL_KEYUP;
+    for(int i = 0; i < 2; i++) {
+        if(keys[i] != 0) {
+            e.key.keysym.sym = keys[i];
+            dot.handleEvent(e);
+        }
+    }
+}
+
+//Frames que mantiene cada punto la misma direccion:
+const int DIRECTION_FRAMES = 60;
+
+//Mapa de tiles de la leccion 39: el nivel repite los tipos de lazy.map hasta
+//tener los tiles pedidos y cada Tile descarta los que no tocan la camara:
+class TileBenchmark : public Benchmark {
+    public:
+        string getName() { return "tilemap"; }
+        string getUnit() { return "tiles"; }
+        vector<int> getSizes() { return {192, 3072, 49152}; }
+
+        bool setup(int size) {
+            int columns = (int)sqrt((double)size);
+            int rows = size / columns;
+            levelWidth = columns * lesson39::TILE_WIDTH;
+            levelHeight = rows * lesson39::TILE_HEIGHT;
+
+            tiles.reserve(columns * rows);
+            for(int i = 0; i < columns * rows; i++) {
+                int type = lesson39Map[i % lesson39::TOTAL_TILES]->getType();
+                tiles.push_back(lesson39::Tile((i % columns) * lesson39::TILE_WIDTH, (i / columns) * lesson39::TILE_HEIGHT, type));
+            }
+            frame = 0;
+
+            return true;
+        }
+
+        void run() {
+            //La camara recorre el nivel en diagonal:
+            SDL_Rect camera = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+            camera.x = (frame * 8) % max(1, levelWidth - SCREEN_WIDTH);
+            camera.y = (frame * 6) % max(1, levelHeight - SCREEN_HEIGHT);
+            frame++;
+
+            for(unsigned int i = 0; i < tiles.size(); i++) {
+                tiles[i].render(camera);
+            }
+        }
+
+        void teardown() {
+            tiles.clear();
+        }
+
+    private:
+        vector<lesson39::Tile> tiles;
+        int levelWidth{0};
+        int levelHeight{0};
+        int frame{0};
+};
+
+//Particulas de la leccion 38: cada Dot lleva TOTAL_PARTICLES particulas que
+//renacen a su alrededor, todo pasa por la cola de render y se vuelca al final:
+class ParticleBenchmark : public Benchmark {
+    public:
+        string getName() { return "particles"; }
+        string getUnit() { return "particles"; }
+        vector<int> getSizes() { return {100, 1000, 10000}; }
+
+        bool setup(int size) {
+            srand(size);
+            int count = max(1, size / lesson38::TOTAL_PARTICLES);
+            for(int i = 0; i < count; i++) {
+                dots.push_back(new lesson38::Dot());
+                sendDirection(*dots[i], i, true);
+            }
+            frame = 0;
+
+            return true;
+        }
+
+        void run() {
+            //Cada cierto tiempo todos los puntos giran a la siguiente direccion:
+            frame++;
+            bool turn = frame % DIRECTION_FRAMES == 0;
+            int direction = frame / DIRECTION_FRAMES;
+            for(unsigned int i = 0; i < dots.size(); i++) {
+                if(turn) {
+                    sendDirection(*dots[i], i + direction - 1, false);
+                    sendDirection(*dots[i], i + direction, true);
+                }
+                dots[i]->move();
+                dots[i]->render();
+            }
+            lesson38::renderQueue.flush();
+        }
+
+        void teardown() {
+            for(unsigned int i = 0; i < dots.size(); i++) {
+                delete dots[i];
+            }
+            dots.clear();
+        }
+
+    private:
+        vector<lesson38::Dot*> dots;
+        int frame{0};
+};
+
+//Colisiones de la leccion 39: cada Dot se mueve por el nivel y se prueba contra
+//todas las paredes del mapa; si choca deshace el movimiento en ese eje:
+class CollisionBenchmark : public Benchmark {
+    public:
+        string getName() { return "collision"; }
+        string getUnit() { return "colliders"; }
+        vector<int> getSizes() { return {100, 1000, 10000}; }
+
+        bool setup(int size) {
+            dots.resize(size);
+            for(int i = 0; i < size; i++) {
+                sendDirection(dots[i], i, true);
+            }
+            frame = 0;
+
+            return true;
+        }
+
+        void run() {
+            frame++;
+            bool turn = frame % DIRECTION_FRAMES == 0;
+            int direction = frame / DIRECTION_FRAMES;
+            for(unsigned int i = 0; i < dots.size(); i++) {
+                if(turn) {
+                    sendDirection(dots[i], i + direction - 1, false);
+                    sendDirection(dots[i], i + direction, true);
+                }
+                dots[i].move(lesson39Map);
+            }
+        }
+
+        void teardown() {
+            dots.clear();
+        }
+
+    private:
+        vector<lesson39::Dot> dots;
+        int frame{0};
+};
+
+//Texto con la fuente bitmap de la leccion 41. Sin cache se maqueta y se dibuja
+//glifo a glifo en cada frame (renderText); con cache cada bloque es un TextRun
+//que solo se maqueta una vez y se dibuja con una llamada por pagina:
+class TextBenchmark : public Benchmark {
+    public:
+        TextBenchmark(bool cached) : cached{cached} {}
+
+        string getName() { return cached ? "text_run" : "text"; }
+        string getUnit() { return "glyphs"; }
+        vector<int> getSizes() { return {256, 4096, 32768}; }
+
+        bool setup(int size) {
+            //Bloques de pocas lineas que se dibujan uno encima de otro, asi
+            //todos los glifos caen dentro de la pantalla:
+            string block;
+            int lines = 0;
+            for(int i = 0; i < size; i++) {
+                block += (char)('!' + i % 94);
+                if(i % LINE_GLYPHS == LINE_GLYPHS - 1 || i == size - 1) {
+                    lines++;
+                    if(lines == BLOCK_LINES || i == size - 1) {
+                        blocks.push_back(block);
+                        block.clear();
+                        lines = 0;
+                    } else {
+                        block += '\n';
+                    }
+                }
+            }
+
+            for(unsigned int i = 0; i < blocks.size(); i++) {
+                runs.push_back(lesson41::TextRun(&lesson41::bitmapFont));
+                runs[i].setText(blocks[i]);
+            }
+
+            return true;
+        }
+
+        void run() {
+            for(unsigned int i = 0; i < blocks.size(); i++) {
+                if(cached) {
+                    runs[i].render(0, 0);
+                } else {
+                    lesson41::bitmapFont.renderText(0, 0, blocks[i]);
+                }
+            }
+        }
+
+        void teardown() {
+            blocks.clear();
+            runs.clear();
+        }
+
+    private:
+        static const int LINE_GLYPHS = 32;
+        static const int BLOCK_LINES = 8;
+
+        bool cached;
+        vector<string> blocks;
+        vector<lesson41::TextRun> runs;
+};
+
+//Subida de pixeles con la StreamingTexture de la leccion 42: se cambia una fila
+//del buffer en cada frame y se sube solo esa region (mas lo que les falte a las
+//otras texturas de la rotacion) antes de dibujarla:
+class UploadBenchmark : public Benchmark {
+    public:
+        string getName() { return "texture_upload"; }
+        string getUnit() { return "pixels"; }
+        vector<int> getSizes() { return {64 * 64, 256 * 256, 1024 * 1024}; }
+
+        bool setup(int size) {
+            width = (int)sqrt((double)size);
+            height = size / width;
+            if(!texture.create(width, height)) {
+                return false;
+            }
+
+            pixels.assign(width * height, 0);
+            frame = 0;
+
+            return true;
+        }
+
+        void run() {
+            //Cambia una fila por frame para que la subida no sea siempre igual:
+            int y = frame % height;
+            Uint32 *row = &pixels[y * width];
+            for(int x = 0; x < width; x++) {
+                row[x] = 0xFF0000FF + (Uint32)(frame << 8);
+            }
+            frame++;
+
+            SDL_Rect dirty = {0, y, width, 1};
+            texture.update(&pixels[0], width * 4, &dirty);
+            texture.render(0, 0);
+        }
+
+        void teardown() {
+            texture.free();
+            pixels.clear();
+        }
+
+    private:
+        lesson42::StreamingTexture texture;
+        vector<Uint32> pixels;
+        int width{0};
+        int height{0};
+        int frame{0};
+};
+
+//Puntos de la leccion 44 (DotStore y sus nucleos): se mide solo la simulacion
+//(movimiento y rebote contra los bordes), sin dibujarlos, con el nucleo SIMD o
+//solo con el escalar:
+class DotBenchmark : public Benchmark {
+    public:
+        DotBenchmark(bool simd) : simd{simd} {}
+
+        string getName() { return simd ? "dots" : "dots_scalar"; }
+        string getUnit() { return "dots"; }
+        vector<int> getSizes() { return {10000, 100000, 1000000}; }
+
+        bool setup(int size) {
+            lesson44::spawnSwarm(dots, size, nullptr);
+            return true;
+        }
+
+        void run() {
+            const float timeStep = 1.f / 60.f;
+            if(simd) {
+                lesson44::updateDots(dots, timeStep);
+            } else {
+                lesson44::updateDotsScalar(dots, timeStep);
+            }
+        }
+
+        void teardown() {
+            dots.clear();
+        }
+
+        bool drawsFrame() { return false; }
+
+    private:
+        bool simd;
+        lesson44::DotStore dots;
+};
+
+//Resultado de un caso con un tamano, tiempos en microsegundos:
+struct BenchmarkResult {
+    double mean;
+    double stddev;
+    double min;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+};
+
+//Percentil por el metodo del rango mas cercano sobre muestras ordenadas:
+double percentile(const vector<double> &sorted, double p) {
+    int rank = (int)ceil(p / 100.0 * sorted.size());
+    if(rank < 1) {
+        rank = 1;
+    }
+    return sorted[rank - 1];
+}
+
+BenchmarkResult summarize(vector<double> samples) {
+    BenchmarkResult result;
+    sort(samples.begin(), samples.end());
+
+    double sum = 0;
+    for(int i = 0; i < (int)samples.size(); i++) {
+        sum += samples[i];
+    }
+    result.mean = sum / samples.size();
+
+    double variance = 0;
+    for(int i = 0; i < (int)samples.size(); i++) {
+        variance += (samples[i] - result.mean) * (samples[i] - result.mean);
+    }
+    result.stddev = samples.size() > 1 ? sqrt(variance / (samples.size() - 1)) : 0;
+
+    result.min = samples.front();
+    result.p50 = percentile(samples, 50);
+    result.p90 = percentile(samples, 90);
+    result.p99 = percentile(samples, 99);
+    result.max = samples.back();
+
+    return result;
+}
+
+//En los casos que dibujan cada iteracion es un frame completo: limpiar, el caso
+//y presentar, para que el renderer no pueda dejar trabajo pendiente para la
+//siguiente muestra. Los demas solo miden su run():
+bool runBenchmark(Benchmark &benchmark, int size, int iterations, int warmup) {
+    if(!benchmark.setup(size)) {
+        cout << "No se pudo preparar " << benchmark.getName() << " con " << size << " " << benchmark.getUnit() << endl;
+        return false;
+    }
+
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    vector<double> samples;
+    samples.reserve(iterations);
+
+    for(int i = 0; i < warmup + iterations; i++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+
+        if(benchmark.drawsFrame()) {
+            SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xFF);
+            SDL_RenderClear(renderer);
+            benchmark.run();
+            SDL_RenderPresent(renderer);
+        } else {
+            benchmark.run();
+        }
+
+        Uint64 end = SDL_GetPerformanceCounter();
+        if(i >= warmup) {
+            samples.push_back((end - start) * 1000000.0 / frequency);
+        }
+    }
+
+    benchmark.teardown();
+
+    BenchmarkResult result = summarize(samples);
+    cout << "{\"case\":\"" << benchmark.getName() << "\""
+         << ",\"unit\":\"" << benchmark.getUnit() << "\""
+         << ",\"size\":" << size
+         << ",\"iterations\":" << iterations
+         << ",\"mean_us\":" << result.mean
+         << ",\"stddev_us\":" << result.stddev
+         << ",\"min_us\":" << result.min
+         << ",\"p50_us\":" << result.p50
+         << ",\"p90_us\":" << result.p90
+         << ",\"p99_us\":" << result.p99
+         << ",\"max_us\":" << result.max
+         << "}" << endl;
+
+    return true;
+}
+
+bool init() {
+    bool success = true;
+
+    //Sin pantalla: driver de video dummy y renderer software sin vsync, asi
+    //los numeros no dependen de la GPU ni del refresco del monitor:
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+
+    if(SDL_Init(SDL_INIT_VIDEO) < 0) {
+        cout << SDL_GetError() << endl;
+        success = false;
+    } else {
+        window = SDL_CreateWindow("Benchmark", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_HIDDEN);
+        if(window == NULL) {
+            cout << SDL_GetError() << endl;
+            success = false;
+        } else {
+            renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE | SDL_RENDERER_TARGETTEXTURE);
+            if(renderer == NULL) {
+                cout << SDL_GetError() << endl;
+                success = false;
+            } else {
+                //Cada leccion dibuja con su propio renderer global:
+                lesson38::renderer = renderer;
+                lesson39::renderer = renderer;
+                lesson41::renderer = renderer;
+                lesson42::renderer = renderer;
+                lesson44::renderer = renderer;
+
+                int imgFlags = IMG_INIT_PNG;
+                if((IMG_Init(imgFlags) & imgFlags) != imgFlags) {
+                    cout << IMG_GetError() << endl;
+                    success = false;
+                }
+            }
+        }
+    }
+
+    return success;
+}
+
+//Los assets se cargan una vez con las funciones de cada leccion:
+bool loadMedia() {
+    bool success = true;
+
+    if(!lesson38::loadMedia()) {
+        success = false;
+    }
+
+    for(int i = 0; i < lesson39::TOTAL_TILES; i++) {
+        lesson39Map[i] = nullptr;
+    }
+    if(!lesson39::loadMedia(lesson39Map)) {
+        success = false;
+    }
+
+    if(!lesson41::loadMedia()) {
+        success = false;
+    }
+
+    return success;
+}
+
+void close() {
+    lesson38::dotTexture.free();
+    lesson38::redTexture.free();
+    lesson38::greenTexture.free();
+    lesson38::blueTexture.free();
+    lesson38::shimmerTexture.free();
+
+    for(int i = 0; i < lesson39::TOTAL_TILES; i++) {
+        delete lesson39Map[i];
+        lesson39Map[i] = nullptr;
+    }
+    lesson39::dotTexture.free();
+    lesson39::tileTexture.free();
+
+    lesson41::bitmapFont.free();
+
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    renderer = NULL;
+    window = NULL;
+
+    IMG_Quit();
+    SDL_Quit();
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = DEFAULT_ITERATIONS;
+    int warmup = DEFAULT_WARMUP;
+    string filter;
+
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--iterations" && i + 1 < argc) {
+            iterations = max(1, atoi(argv[++i]));
+        } else if(arg == "--warmup" && i + 1 < argc) {
+            warmup = max(0, atoi(argv[++i]));
+        } else if(arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            cout << "Uso: " << argv[0] << " [--iterations N] [--warmup N] [--filter nombre]" << endl;
+            return 1;
+        }
+    }
+
+    if(!init() || !loadMedia()) {
+        close();
+        return 1;
+    }
+
+    TileBenchmark tiles;
+    ParticleBenchmark particles;
+    CollisionBenchmark collision;
+    TextBenchmark text(false);
+    TextBenchmark textRun(true);
+    UploadBenchmark upload;
+    DotBenchmark dots(true);
+    DotBenchmark dotsScalar(false);
+    Benchmark *benchmarks[] = {&tiles, &particles, &collision, &text, &textRun, &upload, &dots, &dotsScalar};
+
+    int failed = 0;
+    for(Benchmark *benchmark : benchmarks) {
+        if(!filter.empty() && benchmark->getName().find(filter) == string::npos) {
+            continue;
+        }
+
+        vector<int> sizes = benchmark->getSizes();
+        for(int i = 0; i < (int)sizes.size(); i++) {
+            if(!runBenchmark(*benchmark, sizes[i], iterations, warmup)) {
+                failed++;
+            }
+        }
+    }
+
+    close();
+
+    return failed == 0 ? 0 : 1;
+}
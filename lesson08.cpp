@@ -1,4 +1,5 @@
 #include <SDL.h>
+#include <vector>
 #include <iostream>
 using namespace std;
 
@@ -11,6 +12,127 @@ SDL_Renderer *renderer = NULL;
 bool init();
 void close();
 
+//Agrupa puntos, lineas y rectangulos para mandarlos en pocas llamadas. Solo se
+//juntan dibujados seguidos del mismo color y tipo, asi todo sale en el orden en
+//que se pidio y lo que se dibuja despues queda encima:
+class PrimitiveBatch {
+    public:
+        void drawPoint(int x, int y, SDL_Color color);
+        void drawLine(int x1, int y1, int x2, int y2, SDL_Color color);
+        void drawRect(SDL_Rect rect, SDL_Color color);
+        void fillRect(SDL_Rect rect, SDL_Color color);
+
+        //Manda todo al renderer y vacia el lote:
+        void flush();
+    private:
+        enum RunType { RUN_FILL_RECTS, RUN_RECTS, RUN_LINES, RUN_POINTS };
+
+        //Tramo de dibujados seguidos del mismo color y tipo. start y count son
+        //indices en el vector de su tipo (en lineStarts para las lineas):
+        struct Run {
+            SDL_Color color;
+            RunType type;
+            int start;
+            int count;
+        };
+
+        static bool sameColor(SDL_Color a, SDL_Color b);
+        //Tramo del siguiente dibujado, se abre uno nuevo si cambia el color o el tipo:
+        Run &getRun(SDL_Color color, RunType type, int start);
+
+        //Se reutilizan entre flush para no reservar memoria cada frame:
+        std::vector<Run> runs;
+        std::vector<SDL_Point> points;
+        //Las lineas seguidas se juntan en polilineas, cada una empieza en un indice:
+        std::vector<SDL_Point> linePoints;
+        std::vector<int> lineStarts;
+        std::vector<SDL_Rect> rects;
+        std::vector<SDL_Rect> fillRects;
+};
+
+bool PrimitiveBatch::sameColor(SDL_Color a, SDL_Color b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+PrimitiveBatch::Run &PrimitiveBatch::getRun(SDL_Color color, RunType type, int start) {
+    if(!runs.empty() && runs.back().type == type && sameColor(runs.back().color, color)) {
+        return runs.back();
+    }
+
+    Run run = {color, type, start, 0};
+    runs.push_back(run);
+    return runs.back();
+}
+
+void PrimitiveBatch::drawPoint(int x, int y, SDL_Color color) {
+    SDL_Point point = {x, y};
+    getRun(color, RUN_POINTS, points.size()).count++;
+    points.push_back(point);
+}
+
+void PrimitiveBatch::drawLine(int x1, int y1, int x2, int y2, SDL_Color color) {
+    //Las horizontales y verticales son rectangulos de un pixel de ancho:
+    if(x1 == x2 || y1 == y2) {
+        SDL_Rect rect = {x1 < x2 ? x1 : x2, y1 < y2 ? y1 : y2, (x1 < x2 ? x2 - x1 : x1 - x2) + 1, (y1 < y2 ? y2 - y1 : y1 - y2) + 1};
+        fillRect(rect, color);
+        return;
+    }
+
+    //Si empieza donde acabo la anterior del mismo tramo seguimos la misma polilinea:
+    Run &run = getRun(color, RUN_LINES, lineStarts.size());
+    if(run.count == 0 || linePoints.back().x != x1 || linePoints.back().y != y1) {
+        lineStarts.push_back(linePoints.size());
+        SDL_Point start = {x1, y1};
+        linePoints.push_back(start);
+        run.count++;
+    }
+    SDL_Point end = {x2, y2};
+    linePoints.push_back(end);
+}
+
+void PrimitiveBatch::drawRect(SDL_Rect rect, SDL_Color color) {
+    getRun(color, RUN_RECTS, rects.size()).count++;
+    rects.push_back(rect);
+}
+
+void PrimitiveBatch::fillRect(SDL_Rect rect, SDL_Color color) {
+    getRun(color, RUN_FILL_RECTS, fillRects.size()).count++;
+    fillRects.push_back(rect);
+}
+
+void PrimitiveBatch::flush() {
+    for(unsigned int i = 0; i < runs.size(); i++) {
+        Run &run = runs[i];
+        if(i == 0 || !sameColor(run.color, runs[i - 1].color)) {
+            SDL_SetRenderDrawColor(renderer, run.color.r, run.color.g, run.color.b, run.color.a);
+        }
+
+        if(run.type == RUN_FILL_RECTS) {
+            SDL_RenderFillRects(renderer, &fillRects[run.start], run.count);
+        } else if(run.type == RUN_RECTS) {
+            SDL_RenderDrawRects(renderer, &rects[run.start], run.count);
+        } else if(run.type == RUN_LINES) {
+            for(int line = run.start; line < run.start + run.count; line++) {
+                int start = lineStarts[line];
+                int end = line + 1 < (int)lineStarts.size() ? lineStarts[line + 1] : linePoints.size();
+                SDL_RenderDrawLines(renderer, &linePoints[start], end - start);
+            }
+        } else {
+            SDL_RenderDrawPoints(renderer, &points[run.start], run.count);
+        }
+    }
+
+    //Vaciamos sin liberar la memoria:
+    runs.clear();
+    points.clear();
+    linePoints.clear();
+    lineStarts.clear();
+    rects.clear();
+    fillRects.clear();
+}
+
+PrimitiveBatch batch;
+
 bool init() {
     bool success = true;
 
@@ -60,20 +182,22 @@ int main(int argc, char* args[]) {
             SDL_RenderClear(renderer);
             //Creamos un rectangulo y lo rellenamos de rojo:
             SDL_Rect fillRect = { SCREEN_WIDTH/4 , SCREEN_HEIGHT/4, SCREEN_WIDTH/2, SCREEN_HEIGHT/2 };
-            SDL_SetRenderDrawColor(renderer, 0xFF, 0x00, 0x00, 0xFF);
-            SDL_RenderFillRect(renderer, &fillRect);
+            SDL_Color red = { 0xFF, 0x00, 0x00, 0xFF };
+            batch.fillRect(fillRect, red);
             //Creamos un rectangulo azul:
             SDL_Rect outlineRect = { SCREEN_WIDTH/6, SCREEN_HEIGHT/6, SCREEN_WIDTH*2/3, SCREEN_HEIGHT*2/3 };
-            SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0xFF, 0xFF);
-            SDL_RenderDrawRect(renderer, &outlineRect);
+            SDL_Color blue = { 0x00, 0x00, 0xFF, 0xFF };
+            batch.drawRect(outlineRect, blue);
             //Creamos una linea horizontal verde en el centro:
-            SDL_SetRenderDrawColor(renderer, 0x00, 0xFF, 0x00, 0xFF);
-            SDL_RenderDrawLine(renderer, 0, SCREEN_HEIGHT/2, SCREEN_WIDTH, SCREEN_HEIGHT/2);
+            SDL_Color green = { 0x00, 0xFF, 0x00, 0xFF };
+            batch.drawLine(0, SCREEN_HEIGHT/2, SCREEN_WIDTH, SCREEN_HEIGHT/2, green);
             //Creamos puntos discontinuos verticalmente en el centro:
-            SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0x00, 0xFF);
+            SDL_Color yellow = { 0xFF, 0xFF, 0x00, 0xFF };
             for(int i = 0; i < SCREEN_HEIGHT; i+=4) {
-                SDL_RenderDrawPoint(renderer, SCREEN_WIDTH/2, i);
+                batch.drawPoint(SCREEN_WIDTH/2, i, yellow);
             }
+            //Mandamos todo el lote de una vez:
+            batch.flush();
             //Presentamos lo que hicimos:
             SDL_RenderPresent(renderer);
         }
@@ -1,5 +1,6 @@
 #include <SDL.h>
 #include <SDL_image.h>
+#include <utility>
 #include <iostream>
 using namespace std;
 
@@ -12,6 +13,12 @@ class Texture {
         Texture();
         ~Texture();
 
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
+
         //Para cargar imagen desde una ubicacion:
         bool loadFromFile(string);
 
@@ -53,6 +60,23 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 //Metodo para cargar la textura desde un archivo:
 bool Texture::loadFromFile(string path) {
     free();
@@ -83,6 +107,7 @@ void Texture::free() {
     //En realidad no hay que comprobar si la textura no es nula, ya que SDL_DestroyTexture es seguro ante nulos.
     if(texture != NULL) {
         SDL_DestroyTexture(texture);
+        texture = NULL;
         width = 0;
         height = 0;
     }
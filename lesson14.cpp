@@ -1,6 +1,7 @@
 #include <SDL.h>
 #include <SDL_image.h>
 #include <string>
+#include <utility>
 #include <iostream>
 using namespace std;
 
@@ -19,6 +20,12 @@ class Texture {
         Texture();
         ~Texture();
 
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
+
         bool loadFromFile(string path);
         void free();
         void render(int x, int y, SDL_Rect *clip = NULL);
@@ -41,6 +48,23 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 bool Texture::loadFromFile(string path) {
     SDL_Surface *surface = IMG_Load(path.c_str());
     if(surface == NULL) {
@@ -63,6 +87,7 @@ bool Texture::loadFromFile(string path) {
 void Texture::free() {
     if(texture != NULL) {
         SDL_DestroyTexture(texture);
+        texture = NULL;
         width = 0;
         height = 0;
     }
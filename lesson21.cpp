@@ -2,6 +2,7 @@
 #include <SDL_image.h>
 #include <SDL_mixer.h>
 #include <string>
+#include <utility>
 #include <iostream>
 using namespace std;
 
@@ -15,6 +16,12 @@ class Texture {
     public:
         Texture();
         ~Texture();
+
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
         bool loadFromFile(string path);
         void free();
         void render(int x, int y);
@@ -30,6 +37,19 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+    }
+    return *this;
+}
+
 bool Texture::loadFromFile(string path) {
     SDL_Surface *surface = IMG_Load(path.c_str());
     if(surface == NULL) {
@@ -48,6 +68,7 @@ bool Texture::loadFromFile(string path) {
 void Texture::free() {
     if(texture != NULL) {
         SDL_DestroyTexture(texture);
+        texture = NULL;
     }
 }
 
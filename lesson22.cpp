@@ -2,6 +2,7 @@
 #include <SDL_image.h>
 #include <SDL_ttf.h>
 #include <string>
+#include <utility>
 #include <sstream>
 #include <iostream>
 using namespace std;
@@ -17,6 +18,12 @@ class Texture {
     public:
         Texture();
         ~Texture();
+
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
         bool loadFromFile(string path);
         bool loadFromRenderedText(string textureText, SDL_Color textColor);
         void free();
@@ -39,6 +46,23 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 //Esta funcin no hace falta para este tutorial:
 bool Texture::loadFromFile(string path) {
     SDL_Surface *surf = IMG_Load(path.c_str());
@@ -79,6 +103,7 @@ bool Texture::loadFromRenderedText(string textureText, SDL_Color textColor) {
 void Texture::free() {
     if(texture != NULL) {
         SDL_DestroyTexture(texture);
+        texture = NULL;
         width = 0;
         height = 0;
     }
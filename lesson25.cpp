@@ -1,6 +1,7 @@
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include <string>
+#include <utility>
 #include <sstream>
 #include <iostream>
 using namespace std;
@@ -18,6 +19,12 @@ class Texture {
     public:
         Texture();
         ~Texture();
+
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
         bool loadFromRenderedText(string textureText, SDL_Color textColor);
         void free();
         void render(int x, int y);
@@ -39,6 +46,23 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 bool Texture::loadFromRenderedText(string textureText, SDL_Color textColor) {
     SDL_Surface *surf = TTF_RenderText_Solid(font, textureText.c_str(), textColor);
     if(surf == NULL) {
@@ -60,6 +84,7 @@ bool Texture::loadFromRenderedText(string textureText, SDL_Color textColor) {
 void Texture::free() {
     if(texture != NULL) {
         SDL_DestroyTexture(texture);
+        texture = NULL;
         width = 0;
         height = 0;
     }
@@ -1,5 +1,6 @@
 #include <SDL.h>
 #include <string>
+#include <utility>
 #include <vector>
 #include <iostream>
 using namespace std;
@@ -12,8 +13,15 @@ SDL_Renderer *renderer;
 
 class Texture {
     public:
+        Texture() = default;
         ~Texture();
 
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
+
         bool loadFromFile(string path);
         void free();
         void render(int x, int y);
@@ -21,7 +29,7 @@ class Texture {
         int getWidth();
         int getHeight();
     private:
-        SDL_Texture *texture;
+        SDL_Texture *texture{nullptr};
         int width{0};
         int height{0};
 };
@@ -30,6 +38,23 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 bool Texture::loadFromFile(string path) {
     SDL_Surface *surf = SDL_LoadBMP(path.c_str());
     if(surf == nullptr) {
@@ -52,6 +77,7 @@ bool Texture::loadFromFile(string path) {
 void Texture::free() {
     if(texture != nullptr) {
         SDL_DestroyTexture(texture);
+        texture = nullptr;
         width = 0;
         height = 0;
     }
@@ -1,5 +1,6 @@
 #include <SDL.h>
 #include <string>
+#include <utility>
 #include <iostream>
 using namespace std;
 
@@ -10,8 +11,15 @@ SDL_Renderer *renderer;
 
 class Texture {
     public:
+        Texture() = default;
         ~Texture();
 
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
+
         bool loadFromFile(string path);
         void free();
         void render(int x, int y);
@@ -19,7 +27,7 @@ class Texture {
         int getWidth();
         int getHeight();
     private:
-        SDL_Texture *texture;
+        SDL_Texture *texture{nullptr};
         int width{0};
         int height{0};
 };
@@ -28,6 +36,23 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 bool Texture::loadFromFile(string path) {
     SDL_Surface *surf = SDL_LoadBMP(path.c_str());
     if(surf == nullptr) {
@@ -50,6 +75,7 @@ bool Texture::loadFromFile(string path) {
 void Texture::free() {
     if(texture != nullptr) {
         SDL_DestroyTexture(texture);
+        texture = nullptr;
         width = 0;
         height = 0;
     }
@@ -1,6 +1,7 @@
 #include <SDL.h>
 #include <SDL_image.h>
 #include <string>
+#include <utility>
 #include <iostream>
 using namespace std;
 
@@ -15,8 +16,15 @@ SDL_Window *window;
 
 class Texture {
     public:
+        Texture() = default;
         ~Texture();
 
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
+
         bool loadFromFile(string path);
         void free();
         void render(int x, int y);
@@ -24,7 +32,7 @@ class Texture {
         int getWidth();
         int getHeight();
     private:
-        SDL_Texture *texture;
+        SDL_Texture *texture{nullptr};
         int width{0};
         int height{0};
 };
@@ -33,6 +41,23 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 bool Texture::loadFromFile(string path) {
     SDL_Surface *surf = IMG_Load(path.c_str());
     if(surf == nullptr) {
@@ -54,6 +79,7 @@ bool Texture::loadFromFile(string path) {
 void Texture::free() {
     if(texture != nullptr) {
         SDL_DestroyTexture(texture);
+        texture = nullptr;
         width = 0;
         height = 0;
     }
@@ -1,6 +1,10 @@
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include <string>
+#include <utility>
+#include <vector>
+#include <iterator>
+#include <cstring>
 #include <iostream>
 using namespace std;
 
@@ -13,8 +17,15 @@ TTF_Font *font;
 
 class Texture {
     public:
+        Texture() = default;
         ~Texture();
 
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
+
         bool loadFromRendererText(string inputText, SDL_Color color);
         void free();
         void render(int x, int y);
@@ -22,7 +33,7 @@ class Texture {
         int getWidth();
         int getHeight();
     private:
-        SDL_Texture *texture;
+        SDL_Texture *texture{nullptr};
         int width{0};
         int height{0};
 };
@@ -31,8 +42,26 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 bool Texture::loadFromRendererText(string inputText, SDL_Color color) {
-    SDL_Surface *surf = TTF_RenderText_Solid(font, inputText.c_str(), color);
+    //El editor guarda UTF-8, asi que se rasteriza como UTF-8 y no como Latin-1:
+    SDL_Surface *surf = TTF_RenderUTF8_Solid(font, inputText.c_str(), color);
     if(surf == nullptr) {
         cout << TTF_GetError() << endl;
     } else {
@@ -52,6 +81,7 @@ bool Texture::loadFromRendererText(string inputText, SDL_Color color) {
 void Texture::free() {
     if(texture != nullptr) {
         SDL_DestroyTexture(texture);
+        texture = nullptr;
         width = 0;
         height = 0;
     }
@@ -71,7 +101,355 @@ int Texture::getHeight() {
 }
 
 Texture introduceTexto;
-Texture texto;
+
+//Buffer con hueco: las inserciones y borrados en el cursor no mueven el resto del texto:
+class GapBuffer {
+    public:
+        //Inserta en el cursor, solo copia el texto nuevo:
+        void insert(const char *text, size_t length);
+        //Borra el caracter UTF-8 anterior al cursor y devuelve los bytes borrados:
+        size_t eraseBefore();
+        //Mueve el cursor un caracter UTF-8 y devuelve los bytes recorridos:
+        size_t moveLeft();
+        size_t moveRight();
+
+        //Caracter justo antes y justo despues del cursor, 0 si no hay:
+        char before();
+        char after();
+
+        size_t length();
+        std::string getText(size_t start, size_t count);
+    private:
+        //Mueve el hueco al cursor logico indicado:
+        void moveGap(size_t position);
+        //Se asegura de que el hueco tenga al menos ese tamano:
+        void reserve(size_t needed);
+
+        std::vector<char> buffer;
+        size_t gapStart{0};
+        size_t gapEnd{0};
+};
+
+void GapBuffer::insert(const char *text, size_t count) {
+    if(count == 0) {
+        return;
+    }
+    reserve(count);
+    memcpy(&buffer[gapStart], text, count);
+    gapStart += count;
+}
+
+size_t GapBuffer::eraseBefore() {
+    size_t erased = 0;
+    //Quitamos los bytes de continuacion hasta el inicio del caracter:
+    while(gapStart > 0) {
+        gapStart--;
+        erased++;
+        if((buffer[gapStart] & 0xC0) != 0x80) {
+            break;
+        }
+    }
+    return erased;
+}
+
+size_t GapBuffer::moveLeft() {
+    size_t position = gapStart;
+    while(position > 0) {
+        position--;
+        if((buffer[position] & 0xC0) != 0x80) {
+            break;
+        }
+    }
+    size_t moved = gapStart - position;
+    moveGap(position);
+    return moved;
+}
+
+size_t GapBuffer::moveRight() {
+    size_t moved = 0;
+    if(gapEnd < buffer.size()) {
+        moved = 1;
+        while(gapEnd + moved < buffer.size() && (buffer[gapEnd + moved] & 0xC0) == 0x80) {
+            moved++;
+        }
+        moveGap(gapStart + moved);
+    }
+    return moved;
+}
+
+char GapBuffer::before() {
+    return gapStart > 0 ? buffer[gapStart - 1] : 0;
+}
+
+char GapBuffer::after() {
+    return gapEnd < buffer.size() ? buffer[gapEnd] : 0;
+}
+
+size_t GapBuffer::length() {
+    return buffer.size() - (gapEnd - gapStart);
+}
+
+std::string GapBuffer::getText(size_t start, size_t count) {
+    std::string text;
+    if(count == 0) {
+        return text;
+    }
+    text.reserve(count);
+    size_t end = start + count;
+    //Parte antes del hueco:
+    if(start < gapStart) {
+        size_t stop = end < gapStart ? end : gapStart;
+        text.append(&buffer[start], stop - start);
+    }
+    //Parte despues del hueco:
+    if(end > gapStart) {
+        size_t from = start > gapStart ? start : gapStart;
+        size_t gap = gapEnd - gapStart;
+        text.append(&buffer[from + gap], end - from);
+    }
+    return text;
+}
+
+void GapBuffer::moveGap(size_t position) {
+    if(position < gapStart) {
+        size_t count = gapStart - position;
+        memmove(&buffer[gapEnd - count], &buffer[position], count);
+        gapStart -= count;
+        gapEnd -= count;
+    } else if(position > gapStart) {
+        size_t count = position - gapStart;
+        memmove(&buffer[gapStart], &buffer[gapEnd], count);
+        gapStart += count;
+        gapEnd += count;
+    }
+}
+
+void GapBuffer::reserve(size_t needed) {
+    size_t gap = gapEnd - gapStart;
+    if(gap < needed) {
+        //Crecemos al doble para que pegar muchas veces siga siendo lineal:
+        size_t tail = buffer.size() - gapEnd;
+        size_t newSize = buffer.size() * 2;
+        if(newSize < buffer.size() - gap + needed) {
+            newSize = buffer.size() - gap + needed;
+        }
+        buffer.resize(newSize);
+        if(tail > 0) {
+            memmove(&buffer[newSize - tail], &buffer[gapEnd], tail);
+        }
+        gapEnd = newSize - tail;
+    }
+}
+
+//Bytes que se rasterizan como mucho de una linea, aunque sea mas larga:
+const size_t MAX_LINE_BYTES = 1024;
+
+//Campo de texto multilinea que solo rasteriza las lineas que cambian y se ven:
+class TextEditor {
+    public:
+        TextEditor();
+        ~TextEditor();
+
+        void setColor(SDL_Color color);
+        //Inserta texto en UTF-8 en el cursor, puede contener saltos de linea:
+        void insert(const char *text);
+        void backspace();
+        void moveLeft();
+        void moveRight();
+
+        std::string getText();
+
+        //Renderiza las lineas que caben en el espacio indicado alrededor del cursor:
+        void render(int x, int y, int maxWidth, int maxHeight);
+        void free();
+    private:
+        //Borra la textura cacheada de una linea para regenerarla al dibujarla:
+        void invalidate(size_t line);
+        //Recorta una linea a lo que cabe en el ancho, para no pasarnos del tamano
+        //maximo de textura con una linea enorme sin saltos:
+        std::string fitLine(std::string text, int maxWidth);
+
+        GapBuffer buffer;
+        SDL_Color color{0, 0, 0, 0xFF};
+
+        //Longitud en bytes de cada linea sin el salto y su textura (vacia si hay que regenerarla):
+        std::vector<size_t> lineLengths;
+        std::vector<Texture> lineTextures;
+
+        size_t cursorLine{0};
+        size_t cursorColumn{0};
+};
+
+TextEditor::TextEditor() {
+    lineLengths.push_back(0);
+    lineTextures.push_back(Texture());
+}
+
+TextEditor::~TextEditor() {
+    free();
+}
+
+void TextEditor::setColor(SDL_Color color) {
+    this->color = color;
+    for(size_t i = 0; i < lineTextures.size(); i++) {
+        invalidate(i);
+    }
+}
+
+void TextEditor::insert(const char *text) {
+    //Al pegar texto de Windows los saltos llegan como \r\n, el \r no se guarda:
+    std::string clean;
+    if(strchr(text, '\r') != nullptr) {
+        for(const char *c = text; *c != 0; c++) {
+            if(*c != '\r') {
+                clean += *c;
+            }
+        }
+        text = clean.c_str();
+    }
+
+    size_t count = strlen(text);
+    buffer.insert(text, count);
+
+    //Solo hay que recorrer el texto nuevo para partirlo en lineas:
+    invalidate(cursorLine);
+    size_t rest = lineLengths[cursorLine] - cursorColumn;
+    std::vector<size_t> newLengths;
+    size_t lineStart = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(text[i] == '\n') {
+            newLengths.push_back(i - lineStart);
+            lineStart = i + 1;
+        }
+    }
+
+    if(newLengths.empty()) {
+        lineLengths[cursorLine] += count;
+        cursorColumn += count;
+    } else {
+        //La linea actual se corta en el primer salto y el resto va a la ultima linea nueva:
+        lineLengths[cursorLine] = cursorColumn + newLengths[0];
+        newLengths.erase(newLengths.begin());
+        cursorColumn = count - lineStart;
+        newLengths.push_back(cursorColumn + rest);
+
+        lineLengths.insert(lineLengths.begin() + cursorLine + 1, newLengths.begin(), newLengths.end());
+        std::vector<Texture> newTextures(newLengths.size());
+        lineTextures.insert(lineTextures.begin() + cursorLine + 1, std::make_move_iterator(newTextures.begin()), std::make_move_iterator(newTextures.end()));
+        cursorLine += newLengths.size();
+    }
+}
+
+void TextEditor::backspace() {
+    if(cursorColumn > 0) {
+        size_t erased = buffer.eraseBefore();
+        lineLengths[cursorLine] -= erased;
+        cursorColumn -= erased;
+        invalidate(cursorLine);
+    } else if(cursorLine > 0) {
+        //Borramos el salto y juntamos con la linea anterior:
+        buffer.eraseBefore();
+        invalidate(cursorLine);
+        cursorColumn = lineLengths[cursorLine - 1];
+        lineLengths[cursorLine - 1] += lineLengths[cursorLine];
+        lineLengths.erase(lineLengths.begin() + cursorLine);
+        lineTextures.erase(lineTextures.begin() + cursorLine);
+        cursorLine--;
+        invalidate(cursorLine);
+    }
+}
+
+void TextEditor::moveLeft() {
+    if(buffer.before() == '\n') {
+        buffer.moveLeft();
+        cursorLine--;
+        cursorColumn = lineLengths[cursorLine];
+    } else {
+        cursorColumn -= buffer.moveLeft();
+    }
+}
+
+void TextEditor::moveRight() {
+    if(buffer.after() == '\n') {
+        buffer.moveRight();
+        cursorLine++;
+        cursorColumn = 0;
+    } else {
+        cursorColumn += buffer.moveRight();
+    }
+}
+
+std::string TextEditor::getText() {
+    return buffer.getText(0, buffer.length());
+}
+
+void TextEditor::render(int x, int y, int maxWidth, int maxHeight) {
+    int lineHeight = TTF_FontLineSkip(font);
+    size_t visibleLines = maxHeight / lineHeight;
+    if(visibleLines == 0) {
+        visibleLines = 1;
+    }
+
+    //Mantenemos el cursor en la ultima linea visible:
+    size_t firstLine = cursorLine + 1 > visibleLines ? cursorLine + 1 - visibleLines : 0;
+    size_t lastLine = firstLine + visibleLines;
+    if(lastLine > lineLengths.size()) {
+        lastLine = lineLengths.size();
+    }
+
+    //El offset de la primera linea solo se calcula si hay algo que regenerar:
+    size_t offset = 0;
+    bool haveOffset = false;
+    for(size_t line = firstLine; line < lastLine; line++) {
+        if(lineTextures[line].getWidth() == 0) {
+            if(!haveOffset) {
+                for(size_t i = 0; i < line; i++) {
+                    offset += lineLengths[i] + 1;
+                }
+                haveOffset = true;
+            }
+            std::string text = buffer.getText(offset, lineLengths[line]);
+            text = fitLine(text, maxWidth);
+            lineTextures[line].loadFromRendererText(text != "" ? text : " ", color);
+        }
+        if(haveOffset) {
+            offset += lineLengths[line] + 1;
+        }
+        lineTextures[line].render(x, y + (line - firstLine) * lineHeight);
+    }
+}
+
+void TextEditor::free() {
+    for(size_t i = 0; i < lineTextures.size(); i++) {
+        invalidate(i);
+    }
+}
+
+void TextEditor::invalidate(size_t line) {
+    lineTextures[line].free();
+}
+
+std::string TextEditor::fitLine(std::string text, int maxWidth) {
+    size_t count = text.size() < MAX_LINE_BYTES ? text.size() : MAX_LINE_BYTES;
+    int w = 0;
+    int h = 0;
+    while(count > 0) {
+        //Sin cortar un caracter UTF-8 por la mitad:
+        while(count < text.size() && (text[count] & 0xC0) == 0x80) {
+            count--;
+        }
+        text.resize(count);
+        if(TTF_SizeUTF8(font, text.c_str(), &w, &h) != 0 || w <= maxWidth) {
+            break;
+        }
+        //Recortamos en proporcion a lo que sobra:
+        size_t fit = count * maxWidth / w;
+        count = fit < count ? fit : count - 1;
+    }
+    return text;
+}
+
+TextEditor editor;
 
 bool init() {
     bool success = true;
@@ -121,7 +499,7 @@ bool loadMedia() {
 
 void close() {
     introduceTexto.free();
-    texto.free();
+    editor.free();
     TTF_CloseFont(font);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
@@ -135,45 +513,46 @@ int main(int argc, char* argv[]) {
             bool quit = false;
             SDL_Event e;
             SDL_Color color = {0, 0, 0, 0xFF};
-            string inputText = "Texto";
-            texto.loadFromRendererText(inputText, color);
+            editor.setColor(color);
+            editor.insert("Texto");
 
             //Habilitamos la introduccion de texto:
             SDL_StartTextInput();
             while(!quit) {
-                bool renderText = false;
                 while(SDL_PollEvent(&e) != 0) {
                     if(e.type == SDL_QUIT) {
                         quit = true;
                     } else if(e.type == SDL_KEYDOWN) {
-                        //Vamos a comprobar si se borran letras y si se copia o se pega:
-                        if(e.key.keysym.sym == SDLK_BACKSPACE && inputText.length() > 0) {
-                            inputText.pop_back();
-                            renderText = true;
+                        //Vamos a comprobar si se borran letras, se mueve el cursor y si se copia o se pega:
+                        if(e.key.keysym.sym == SDLK_BACKSPACE) {
+                            editor.backspace();
+                        } else if(e.key.keysym.sym == SDLK_RETURN) {
+                            editor.insert("\n");
+                        } else if(e.key.keysym.sym == SDLK_LEFT) {
+                            editor.moveLeft();
+                        } else if(e.key.keysym.sym == SDLK_RIGHT) {
+                            editor.moveRight();
                         } else if(e.key.keysym.sym == SDLK_c && SDL_GetModState() & KMOD_CTRL) {
-                            SDL_SetClipboardText(inputText.c_str());
+                            SDL_SetClipboardText(editor.getText().c_str());
                         } else if(e.key.keysym.sym == SDLK_v && SDL_GetModState() & KMOD_CTRL) {
-                            inputText = SDL_GetClipboardText();
-                            renderText = true;
+                            //Pegar solo copia el texto en el hueco del buffer:
+                            char *clipboard = SDL_GetClipboardText();
+                            if(clipboard != nullptr) {
+                                editor.insert(clipboard);
+                                SDL_free(clipboard);
+                            }
                         }
                     } else if(e.type == SDL_TEXTINPUT) {
                         if(!((e.text.text[0] == 'c' || e.text.text[0] == 'C') && (e.text.text[0] == 'v' || e.text.text[0] == 'V') && (SDL_GetModState() & KMOD_CTRL))) {
-                            inputText += e.text.text;
-                            renderText = true;
+                            editor.insert(e.text.text);
                         }
                     }
                 }
-                if(renderText) {
-                    if(inputText != "") {
-                        texto.loadFromRendererText(inputText, color);
-                    } else {
-                        texto.loadFromRendererText(" ", color);
-                    }
-                }
                 SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
                 SDL_RenderClear(renderer);
                 introduceTexto.render((SCREEN_WIDTH - introduceTexto.getWidth())/2, 0);
-                texto.render((SCREEN_WIDTH - introduceTexto.getWidth())/2, introduceTexto.getHeight());
+                int editorX = (SCREEN_WIDTH - introduceTexto.getWidth())/2;
+                editor.render(editorX, introduceTexto.getHeight(), SCREEN_WIDTH - editorX, SCREEN_HEIGHT - introduceTexto.getHeight());
                 SDL_RenderPresent(renderer);
             }
             SDL_StopTextInput();
@@ -1,6 +1,10 @@
 #include <SDL.h>
 #include <cstdlib>
 #include <string>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <functional>
 #include <iostream>
 using namespace std;
 
@@ -12,20 +16,367 @@ const int TOTAL_PARTICLES = 20;
 SDL_Renderer *renderer;
 SDL_Window *window;
 
+//Modo headless para medir rendimiento sin pantalla: driver de video dummy,
+//renderer software sin vsync y un numero fijo de frames:
+bool headless = false;
+int headlessFrames = 0;
+
+//Archivos para grabar o reproducir la entrada (--record, --replay y
+//--replay-fast, que reproduce sin esperar):
+std::string recordPath;
+std::string replayPath;
+bool replayFast = false;
+
+//Lee --headless <frames> de la linea de comandos:
+void parseArgs(int argc, char* argv[]) {
+    for(int i = 1; i < argc; i++) {
+        if(std::string(argv[i]) == "--headless" && i + 1 < argc) {
+            headless = true;
+            headlessFrames = atoi(argv[++i]);
+        } else if(std::string(argv[i]) == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if(std::string(argv[i]) == "--replay" && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if(std::string(argv[i]) == "--replay-fast" && i + 1 < argc) {
+            replayPath = argv[++i];
+            replayFast = true;
+        }
+    }
+}
+
+//Imprime los frames por segundo al acabar:
+void reportFrames(int frames, Uint64 elapsed) {
+    double seconds = (double)elapsed / SDL_GetPerformanceFrequency();
+    cout << "frames: " << frames << ", segundos: " << seconds << ", fps: " << (seconds > 0 ? frames / seconds : 0) << endl;
+}
+
+//Entrada guionizada del modo headless: el punto da vueltas en cuadrado:
+struct ScriptedKey {
+    int frame;
+    SDL_Keycode key;
+    bool down;
+};
+
+const ScriptedKey INPUT_SCRIPT[] = {
+    {0, SDLK_RIGHT, true},
+    {40, SDLK_RIGHT, false},
+    {40, SDLK_DOWN, true},
+    {80, SDLK_DOWN, false},
+    {80, SDLK_LEFT, true},
+    {120, SDLK_LEFT, false},
+    {120, SDLK_UP, true},
+    {159, SDLK_UP, false}
+};
+const int INPUT_SCRIPT_LENGTH = 8;
+const int INPUT_SCRIPT_PERIOD = 160;
+
+//Mete en la cola de eventos las teclas del guion para este frame:
+void pushScriptedInput(int frame) {
+    int scriptFrame = frame % INPUT_SCRIPT_PERIOD;
+    for(int i = 0; i < INPUT_SCRIPT_LENGTH; i++) {
+        if(INPUT_SCRIPT[i].frame == scriptFrame) {
+            SDL_Event event;
+            memset(&event, 0, sizeof(event));
+            event.type = INPUT_SCRIPT[i].down ? SDL_KEYDOWN : SDL_KEYUP;
+            event.key.keysym.sym = INPUT_SCRIPT[i].key;
+            SDL_PushEvent(&event);
+        }
+    }
+}
+
+//Grabacion y reproduccion de la entrada para poder repetir una sesion exacta.
+//Cada evento se guarda con el frame en que se leyo, los ms desde el inicio y
+//solo los campos que usa su tipo:
+const Uint32 EVENT_LOG_MAGIC = 0x31525645; //"EVR1"
+
+bool isRecordable(Uint32 type) {
+    return type == SDL_QUIT || type == SDL_KEYDOWN || type == SDL_KEYUP || type == SDL_TEXTINPUT ||
+           type == SDL_MOUSEMOTION || type == SDL_MOUSEBUTTONDOWN || type == SDL_MOUSEBUTTONUP;
+}
+
+void writeEvent(SDL_RWops *file, const SDL_Event &e) {
+    SDL_WriteLE32(file, e.type);
+    switch(e.type) {
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            SDL_WriteU8(file, e.key.state);
+            SDL_WriteU8(file, e.key.repeat);
+            SDL_WriteLE32(file, e.key.keysym.scancode);
+            SDL_WriteLE32(file, e.key.keysym.sym);
+            SDL_WriteLE16(file, e.key.keysym.mod);
+            break;
+        case SDL_TEXTINPUT: {
+            Uint8 length = (Uint8)strlen(e.text.text);
+            SDL_WriteU8(file, length);
+            SDL_RWwrite(file, e.text.text, 1, length);
+            break;
+        }
+        case SDL_MOUSEMOTION:
+            SDL_WriteLE32(file, e.motion.state);
+            SDL_WriteLE32(file, e.motion.x);
+            SDL_WriteLE32(file, e.motion.y);
+            SDL_WriteLE32(file, e.motion.xrel);
+            SDL_WriteLE32(file, e.motion.yrel);
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            SDL_WriteU8(file, e.button.button);
+            SDL_WriteU8(file, e.button.state);
+            SDL_WriteU8(file, e.button.clicks);
+            SDL_WriteLE32(file, e.button.x);
+            SDL_WriteLE32(file, e.button.y);
+            break;
+    }
+}
+
+//Lecturas que devuelven false si el fichero se acaba a mitad del valor:
+bool readU8(SDL_RWops *file, Uint8 &value) {
+    return SDL_RWread(file, &value, 1, 1) == 1;
+}
+
+bool readLE16(SDL_RWops *file, Uint16 &value) {
+    if(SDL_RWread(file, &value, sizeof(value), 1) != 1) {
+        return false;
+    }
+    value = SDL_SwapLE16(value);
+    return true;
+}
+
+bool readLE32(SDL_RWops *file, Uint32 &value) {
+    if(SDL_RWread(file, &value, sizeof(value), 1) != 1) {
+        return false;
+    }
+    value = SDL_SwapLE32(value);
+    return true;
+}
+
+//Devuelve false si el evento esta cortado o no es de un tipo que se grabe:
+bool readEvent(SDL_RWops *file, SDL_Event &e) {
+    memset(&e, 0, sizeof(e));
+    if(!readLE32(file, e.type)) {
+        return false;
+    }
+
+    bool success = true;
+    switch(e.type) {
+        case SDL_KEYDOWN:
+        case SDL_KEYUP: {
+            Uint32 scancode = 0;
+            Uint32 sym = 0;
+            success = readU8(file, e.key.state) && readU8(file, e.key.repeat) && readLE32(file, scancode) &&
+                      readLE32(file, sym) && readLE16(file, e.key.keysym.mod);
+            e.key.keysym.scancode = (SDL_Scancode)scancode;
+            e.key.keysym.sym = (SDL_Keycode)sym;
+            break;
+        }
+        case SDL_TEXTINPUT: {
+            Uint8 length = 0;
+            success = readU8(file, length) && length < sizeof(e.text.text) && SDL_RWread(file, e.text.text, 1, length) == length;
+            break;
+        }
+        case SDL_MOUSEMOTION: {
+            Uint32 values[4] = {0, 0, 0, 0};
+            success = readLE32(file, e.motion.state) && readLE32(file, values[0]) && readLE32(file, values[1]) &&
+                      readLE32(file, values[2]) && readLE32(file, values[3]);
+            e.motion.x = (Sint32)values[0];
+            e.motion.y = (Sint32)values[1];
+            e.motion.xrel = (Sint32)values[2];
+            e.motion.yrel = (Sint32)values[3];
+            break;
+        }
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP: {
+            Uint32 values[2] = {0, 0};
+            success = readU8(file, e.button.button) && readU8(file, e.button.state) && readU8(file, e.button.clicks) &&
+                      readLE32(file, values[0]) && readLE32(file, values[1]);
+            e.button.x = (Sint32)values[0];
+            e.button.y = (Sint32)values[1];
+            break;
+        }
+        case SDL_QUIT:
+            break;
+        default:
+            success = false;
+            break;
+    }
+    return success;
+}
+
+class EventRecorder {
+    public:
+        ~EventRecorder();
+
+        bool open(std::string path);
+        void close();
+        bool isOpen();
+
+        //Guarda un evento leido en el frame dado, si es de entrada:
+        void record(int frame, const SDL_Event &e);
+
+    private:
+        SDL_RWops *file{nullptr};
+        Uint32 startTime{0};
+};
+
+EventRecorder::~EventRecorder() {
+    close();
+}
+
+bool EventRecorder::open(std::string path) {
+    close();
+
+    file = SDL_RWFromFile(path.c_str(), "wb");
+    if(file == nullptr) {
+        cout << SDL_GetError() << endl;
+        return false;
+    }
+
+    SDL_WriteLE32(file, EVENT_LOG_MAGIC);
+    startTime = SDL_GetTicks();
+
+    return true;
+}
+
+void EventRecorder::close() {
+    if(file != nullptr) {
+        SDL_RWclose(file);
+        file = nullptr;
+    }
+}
+
+bool EventRecorder::isOpen() {
+    return file != nullptr;
+}
+
+void EventRecorder::record(int frame, const SDL_Event &e) {
+    if(file == nullptr || !isRecordable(e.type)) {
+        return;
+    }
+
+    SDL_WriteLE32(file, frame);
+    SDL_WriteLE32(file, SDL_GetTicks() - startTime);
+    writeEvent(file, e);
+}
+
+class EventReplayer {
+    public:
+        //Con fast los eventos se meten sin esperar, para ir lo mas rapido posible:
+        bool open(std::string path, bool fast);
+        void close();
+        bool isOpen();
+        bool isFinished();
+
+        //Anade a events los eventos grabados hasta este frame. No pasan por la
+        //cola de SDL para no mezclarse con la entrada real:
+        void takeEvents(int frame, vector<SDL_Event> &events);
+
+    private:
+        struct RecordedEvent {
+            Uint32 frame;
+            Uint32 time;
+            SDL_Event event;
+        };
+
+        vector<RecordedEvent> events;
+        size_t next{0};
+        bool loaded{false};
+        bool fast{false};
+        Uint32 startTime{0};
+};
+
+bool EventReplayer::open(std::string path, bool fast) {
+    close();
+
+    SDL_RWops *file = SDL_RWFromFile(path.c_str(), "rb");
+    if(file == nullptr) {
+        cout << SDL_GetError() << endl;
+        return false;
+    }
+
+    Uint32 magic = 0;
+    if(!readLE32(file, magic) || magic != EVENT_LOG_MAGIC) {
+        cout << "El archivo " << path << " no es una grabacion de eventos" << endl;
+        SDL_RWclose(file);
+        return false;
+    }
+
+    //Si la grabacion se corto (por ejemplo al matar el programa) se reproduce
+    //hasta el ultimo evento completo y no se mete nada a medio leer:
+    RecordedEvent recorded;
+    while(readLE32(file, recorded.frame)) {
+        if(!readLE32(file, recorded.time) || !readEvent(file, recorded.event)) {
+            cout << "La grabacion " << path << " esta cortada, se para en el evento " << events.size() << endl;
+            break;
+        }
+        events.push_back(recorded);
+    }
+    SDL_RWclose(file);
+
+    next = 0;
+    loaded = true;
+    this->fast = fast;
+    startTime = SDL_GetTicks();
+
+    return true;
+}
+
+void EventReplayer::close() {
+    events.clear();
+    next = 0;
+    loaded = false;
+}
+
+bool EventReplayer::isOpen() {
+    return loaded;
+}
+
+bool EventReplayer::isFinished() {
+    return next >= events.size();
+}
+
+void EventReplayer::takeEvents(int frame, vector<SDL_Event> &events) {
+    while(next < this->events.size() && this->events[next].frame <= (Uint32)frame) {
+        //A velocidad real se espera a que llegue el momento en que se grabo:
+        if(!fast) {
+            Uint32 elapsed = SDL_GetTicks() - startTime;
+            if(elapsed < this->events[next].time) {
+                SDL_Delay(this->events[next].time - elapsed);
+            }
+        }
+
+        events.push_back(this->events[next].event);
+        next++;
+    }
+}
+
+EventRecorder recorder;
+EventReplayer replayer;
+
 class Texture {
     public:
+        Texture() = default;
         ~Texture();
 
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
+
         bool loadFromFile(string path);
         void free();
         void render(int x, int y, SDL_Rect *clip = NULL);
 
         void setAlpha(Uint8 alpha);
 
+        //Estado que cuenta para ordenar los dibujados:
+        SDL_Texture *getTexture();
+        SDL_BlendMode getBlendMode();
+
         int getWidth();
         int getHeight();
     private:
-        SDL_Texture *texture;
+        SDL_Texture *texture{nullptr};
         int width{0};
         int height{0};
 };
@@ -34,6 +385,23 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 bool Texture::loadFromFile(string path) {
     SDL_Surface *surf = SDL_LoadBMP(path.c_str());
     if(surf == nullptr) {
@@ -56,6 +424,7 @@ bool Texture::loadFromFile(string path) {
 void Texture::free() {
     if(texture != nullptr) {
         SDL_DestroyTexture(texture);
+        texture = nullptr;
         width = 0;
         height = 0;
     }
@@ -74,6 +443,16 @@ void Texture::setAlpha(Uint8 alpha) {
     SDL_SetTextureAlphaMod(texture, alpha);
 }
 
+SDL_Texture *Texture::getTexture() {
+    return texture;
+}
+
+SDL_BlendMode Texture::getBlendMode() {
+    SDL_BlendMode mode = SDL_BLENDMODE_NONE;
+    SDL_GetTextureBlendMode(texture, &mode);
+    return mode;
+}
+
 int Texture::getWidth() {
     return width;
 }
@@ -88,6 +467,197 @@ Texture greenTexture;
 Texture blueTexture;
 Texture shimmerTexture;
 
+//Capas de dibujado, se pintan de menor a mayor:
+const int LAYER_DOT = 0;
+const int LAYER_PARTICLES = 1;
+
+//Cuantos dibujados se miran como mucho al adelantar uno en una capa ordenada.
+//Si hacen falta mas se queda donde esta, que siempre da la misma imagen:
+const int MAX_OVERLAP_CHECKS = 64;
+
+//Cola de dibujado: agrupa por textura y blend mode dentro de cada capa antes de mandar nada:
+class RenderQueue {
+    public:
+        //Las capas ordenadas dan la misma imagen que el orden en el que se pidieron
+        //los dibujados: uno solo se adelanta a los que no se solapan con el.
+        //Las que tienen algun dibujado con blending se tratan siempre asi:
+        void setLayerOrdered(int layer, bool ordered);
+
+        void push(int layer, Texture *texture, int x, int y, SDL_Rect *clip = NULL);
+        //Ordena, dibuja y vacia la cola:
+        void flush();
+
+        //Cambios de textura o blend mode del ultimo flush, sin ordenar y ordenados:
+        int getUnsortedStateChanges();
+        int getSortedStateChanges();
+    private:
+        struct DrawCommand {
+            int layer;
+            SDL_BlendMode blendMode;
+            SDL_Texture *key;
+            Texture *texture;
+            //Donde se dibuja en pantalla:
+            SDL_Rect dest;
+            bool hasClip;
+            SDL_Rect clip;
+        };
+
+        //Dibujados con el mismo estado que van seguidos y el rectangulo que cubren:
+        struct Batch {
+            std::vector<DrawCommand> commands;
+            SDL_Rect bounds;
+        };
+
+        static bool sameState(const DrawCommand &a, const DrawCommand &b);
+        static int countStateChanges(const std::vector<DrawCommand> &commands);
+        //Agrupa [first, last) sin cambiar el orden entre dibujados que se solapan:
+        void batchInOrder(std::vector<DrawCommand>::iterator first, std::vector<DrawCommand>::iterator last);
+
+        std::vector<DrawCommand> commands;
+        std::vector<int> orderedLayers;
+
+        //Grupos de batchInOrder; se reutilizan entre frames para no reservar memoria:
+        std::vector<Batch> batches;
+        unsigned int batchCount{0};
+
+        int unsortedStateChanges{0};
+        int sortedStateChanges{0};
+};
+
+void RenderQueue::setLayerOrdered(int layer, bool ordered) {
+    std::vector<int>::iterator it = std::find(orderedLayers.begin(), orderedLayers.end(), layer);
+    if(ordered && it == orderedLayers.end()) {
+        orderedLayers.push_back(layer);
+    } else if(!ordered && it != orderedLayers.end()) {
+        orderedLayers.erase(it);
+    }
+}
+
+void RenderQueue::push(int layer, Texture *texture, int x, int y, SDL_Rect *clip) {
+    DrawCommand command = {layer, texture->getBlendMode(), texture->getTexture(), texture,
+                           {x, y, texture->getWidth(), texture->getHeight()}, clip != nullptr, {0, 0, 0, 0}};
+    if(clip != nullptr) {
+        command.clip = *clip;
+        command.dest.w = clip->w;
+        command.dest.h = clip->h;
+    }
+    commands.push_back(command);
+}
+
+bool RenderQueue::sameState(const DrawCommand &a, const DrawCommand &b) {
+    return a.key == b.key && a.blendMode == b.blendMode;
+}
+
+int RenderQueue::countStateChanges(const std::vector<DrawCommand> &commands) {
+    int changes = 0;
+    for(unsigned int i = 0; i < commands.size(); i++) {
+        if(i == 0 || !sameState(commands[i], commands[i - 1])) {
+            changes++;
+        }
+    }
+    return changes;
+}
+
+void RenderQueue::batchInOrder(std::vector<DrawCommand>::iterator first, std::vector<DrawCommand>::iterator last) {
+    batchCount = 0;
+    for(std::vector<DrawCommand>::iterator it = first; it != last; ++it) {
+        //Buscamos hacia atras un grupo con el mismo estado. Para llegar a el el
+        //dibujado tiene que pasar por delante de los grupos de en medio, y solo
+        //puede si no toca ninguno de sus dibujados:
+        int target = -1;
+        int checks = 0;
+        for(int b = (int)batchCount - 1; b >= 0; b--) {
+            Batch &batch = batches[b];
+            if(sameState(batch.commands[0], *it)) {
+                target = b;
+                break;
+            }
+            if(SDL_HasIntersection(&batch.bounds, &it->dest)) {
+                checks += batch.commands.size();
+                if(checks > MAX_OVERLAP_CHECKS) {
+                    break;
+                }
+                bool overlaps = false;
+                for(unsigned int i = 0; i < batch.commands.size() && !overlaps; i++) {
+                    overlaps = SDL_HasIntersection(&batch.commands[i].dest, &it->dest) == SDL_TRUE;
+                }
+                if(overlaps) {
+                    break;
+                }
+            }
+        }
+
+        if(target == -1) {
+            if(batchCount == batches.size()) {
+                batches.push_back(Batch());
+            }
+            target = batchCount++;
+            batches[target].commands.clear();
+            batches[target].bounds = it->dest;
+        } else {
+            SDL_UnionRect(&batches[target].bounds, &it->dest, &batches[target].bounds);
+        }
+        batches[target].commands.push_back(*it);
+    }
+
+    for(unsigned int b = 0; b < batchCount; b++) {
+        first = std::copy(batches[b].commands.begin(), batches[b].commands.end(), first);
+    }
+}
+
+void RenderQueue::flush() {
+    unsortedStateChanges = countStateChanges(commands);
+
+    //Primero por capa; stable_sort mantiene el orden en el que se pidieron dentro de cada una:
+    std::stable_sort(commands.begin(), commands.end(), [](const DrawCommand &a, const DrawCommand &b) {
+        return a.layer < b.layer;
+    });
+
+    std::vector<DrawCommand>::iterator first = commands.begin();
+    while(first != commands.end()) {
+        int layer = first->layer;
+        std::vector<DrawCommand>::iterator last = first;
+        //Mezclar colores depende del orden, asi que una capa con blending va como las ordenadas:
+        bool ordered = std::find(orderedLayers.begin(), orderedLayers.end(), layer) != orderedLayers.end();
+        while(last != commands.end() && last->layer == layer) {
+            ordered = ordered || last->blendMode != SDL_BLENDMODE_NONE;
+            ++last;
+        }
+
+        if(ordered) {
+            batchInOrder(first, last);
+        } else {
+            //Capa libre: por blend mode y textura sin mirar nada mas:
+            std::stable_sort(first, last, [](const DrawCommand &a, const DrawCommand &b) {
+                if(a.blendMode != b.blendMode) {
+                    return a.blendMode < b.blendMode;
+                }
+                //std::less da un orden total entre punteros, < no lo garantiza:
+                return std::less<SDL_Texture*>()(a.key, b.key);
+            });
+        }
+        first = last;
+    }
+
+    sortedStateChanges = countStateChanges(commands);
+
+    for(unsigned int i = 0; i < commands.size(); i++) {
+        DrawCommand &command = commands[i];
+        command.texture->render(command.dest.x, command.dest.y, command.hasClip ? &command.clip : nullptr);
+    }
+    commands.clear();
+}
+
+int RenderQueue::getUnsortedStateChanges() {
+    return unsortedStateChanges;
+}
+
+int RenderQueue::getSortedStateChanges() {
+    return sortedStateChanges;
+}
+
+RenderQueue renderQueue;
+
 class Particle {
     public:
         Particle(int x, int y);
@@ -112,12 +682,13 @@ Particle::Particle(int x, int y):
 }
 
 void Particle::render() {
-    //Renderizamos la particula:
-    texture->render(x, y);
+    //Encolamos la particula:
+    renderQueue.push(LAYER_PARTICLES, texture, x, y);
 
-    //Renderizamos el brillo cada dos frames:
+    //Y el brillo cada dos frames; la cola lo junta con otros brillos si por
+    //el camino no pisa ninguna particula:
     if(frame %2 == 0) {
-        shimmerTexture.render(x, y);
+        renderQueue.push(LAYER_PARTICLES, &shimmerTexture, x, y);
     }
 
     //Animamos la particula:
@@ -200,7 +771,7 @@ void Dot::move() {
 }
 
 void Dot::render() {
-    dotTexture.render(x, y);
+    renderQueue.push(LAYER_DOT, &dotTexture, x, y);
     //Tambien renderizamos las particulas:
     renderPartciles();
 }
@@ -220,6 +791,11 @@ void Dot::renderPartciles() {
 bool init() {
     bool success = true;
 
+    //En modo headless no hay pantalla, usamos el driver dummy:
+    if(headless) {
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    }
+
     if(SDL_Init(SDL_INIT_VIDEO) < 0) {
         cout << SDL_GetError() << endl;
         success = false;
@@ -229,7 +805,7 @@ bool init() {
             cout << SDL_GetError() << endl;
             success = false;
         } else {
-            renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+            renderer = SDL_CreateRenderer(window, -1, headless ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
             if(renderer == nullptr) {
                 cout << SDL_GetError() << endl;
                 success = false;
@@ -277,24 +853,63 @@ void close() {
     greenTexture.free();
     blueTexture.free();
     shimmerTexture.free();
+    recorder.close();
+    replayer.close();
+
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
 }
 
+//benchmark.cpp incluye este archivo para medir las particulas y la cola de render, sin su main:
+#ifndef LESSON_NO_MAIN
 int main(int argc, char* argv[]) {
+    parseArgs(argc, argv);
+
     if(init()) {
         if(loadMedia()) {
             bool quit = false;
             SDL_Event e;
             Dot dot;
+
+            //Cambios de estado mostrados en el titulo, solo se actualiza si cambian:
+            int lastUnsorted = -1;
+            int lastSorted = -1;
+            //Grabacion o reproduccion de la entrada si se pidio:
+            if(!recordPath.empty() && !recorder.open(recordPath)) {
+                quit = true;
+            }
+            if(!replayPath.empty() && !replayer.open(replayPath, replayFast)) {
+                quit = true;
+            }
+
+            //Entrada de cada frame: la grabada si se reproduce y la que llega de SDL:
+            vector<SDL_Event> input;
+
+            //Contador de frames y tiempo para el modo headless:
+            int frame = 0;
+            Uint64 startCounter = SDL_GetPerformanceCounter();
             while(!quit) {
+                if(replayer.isOpen()) {
+                    replayer.takeEvents(frame, input);
+                } else if(headless) {
+                    pushScriptedInput(frame);
+                }
                 while(SDL_PollEvent(&e) != 0) {
-                    if(e.type == SDL_QUIT) {
+                    //Al reproducir solo cuenta la entrada grabada, salvo cerrar la ventana:
+                    if(replayer.isOpen() && isRecordable(e.type) && e.type != SDL_QUIT) {
+                        continue;
+                    }
+                    input.push_back(e);
+                }
+                for(unsigned int i = 0; i < input.size(); i++) {
+                    recorder.record(frame, input[i]);
+                    if(input[i].type == SDL_QUIT) {
                         quit = true;
                     }
-                    dot.handleEvent(e);
+                    dot.handleEvent(input[i]);
                 }
+                input.clear();
 
                 dot.move();
 
@@ -302,12 +917,27 @@ int main(int argc, char* argv[]) {
                 SDL_RenderClear(renderer);
 
                 dot.render();
+                renderQueue.flush();
+
+                if(renderQueue.getUnsortedStateChanges() != lastUnsorted || renderQueue.getSortedStateChanges() != lastSorted) {
+                    lastUnsorted = renderQueue.getUnsortedStateChanges();
+                    lastSorted = renderQueue.getSortedStateChanges();
+                    std::string title = "Ejemplo simple de particulas - cambios de estado: " + to_string(lastUnsorted) + " sin ordenar, " + to_string(lastSorted) + " ordenados";
+                    SDL_SetWindowTitle(window, title.c_str());
+                }
 
                 SDL_RenderPresent(renderer);
+
+                frame++;
+                if(headless && frame >= headlessFrames) {
+                    reportFrames(frame, SDL_GetPerformanceCounter() - startCounter);
+                    quit = true;
+                }
             }
         }
     }
     close();
     return 0;
 }
+#endif
 
@@ -1,7 +1,11 @@
 #include <SDL.h>
 #include <SDL_image.h>
 #include <string>
+#include <utility>
+#include <cstring>
+#include <cstdlib>
 #include <fstream>
+#include <vector>
 #include <iostream>
 using namespace std;
 
@@ -43,51 +47,483 @@ bool checkCollision(SDL_Rect a, SDL_Rect b) {
 SDL_Renderer *renderer;
 SDL_Window *window;
 
+//Modo headless para medir rendimiento sin pantalla: driver de video dummy,
+//renderer software sin vsync y un numero fijo de frames:
+bool headless = false;
+int headlessFrames = 0;
+
+//Archivos para grabar o reproducir la entrada (--record, --replay y
+//--replay-fast, que reproduce sin esperar):
+std::string recordPath;
+std::string replayPath;
+bool replayFast = false;
+
+//Lee --headless <frames> de la linea de comandos:
+void parseArgs(int argc, char* argv[]) {
+    for(int i = 1; i < argc; i++) {
+        if(std::string(argv[i]) == "--headless" && i + 1 < argc) {
+            headless = true;
+            headlessFrames = atoi(argv[++i]);
+        } else if(std::string(argv[i]) == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if(std::string(argv[i]) == "--replay" && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if(std::string(argv[i]) == "--replay-fast" && i + 1 < argc) {
+            replayPath = argv[++i];
+            replayFast = true;
+        }
+    }
+}
+
+//Imprime los frames por segundo al acabar:
+void reportFrames(int frames, Uint64 elapsed) {
+    double seconds = (double)elapsed / SDL_GetPerformanceFrequency();
+    cout << "frames: " << frames << ", segundos: " << seconds << ", fps: " << (seconds > 0 ? frames / seconds : 0) << endl;
+}
+
+//Entrada guionizada del modo headless: el punto da vueltas en cuadrado:
+struct ScriptedKey {
+    int frame;
+    SDL_Keycode key;
+    bool down;
+};
+
+const ScriptedKey INPUT_SCRIPT[] = {
+    {0, SDLK_RIGHT, true},
+    {40, SDLK_RIGHT, false},
+    {40, SDLK_DOWN, true},
+    {80, SDLK_DOWN, false},
+    {80, SDLK_LEFT, true},
+    {120, SDLK_LEFT, false},
+    {120, SDLK_UP, true},
+    {159, SDLK_UP, false}
+};
+const int INPUT_SCRIPT_LENGTH = 8;
+const int INPUT_SCRIPT_PERIOD = 160;
+
+//Mete en la cola de eventos las teclas del guion para este frame:
+void pushScriptedInput(int frame) {
+    int scriptFrame = frame % INPUT_SCRIPT_PERIOD;
+    for(int i = 0; i < INPUT_SCRIPT_LENGTH; i++) {
+        if(INPUT_SCRIPT[i].frame == scriptFrame) {
+            SDL_Event event;
+            memset(&event, 0, sizeof(event));
+            event.type = INPUT_SCRIPT[i].down ? SDL_KEYDOWN : SDL_KEYUP;
+            event.key.keysym.sym = INPUT_SCRIPT[i].key;
+            SDL_PushEvent(&event);
+        }
+    }
+}
+
+//Grabacion y reproduccion de la entrada para poder repetir una sesion exacta.
+//Cada evento se guarda con el frame en que se leyo, los ms desde el inicio y
+//solo los campos que usa su tipo:
+const Uint32 EVENT_LOG_MAGIC = 0x31525645; //"EVR1"
+
+bool isRecordable(Uint32 type) {
+    return type == SDL_QUIT || type == SDL_KEYDOWN || type == SDL_KEYUP || type == SDL_TEXTINPUT ||
+           type == SDL_MOUSEMOTION || type == SDL_MOUSEBUTTONDOWN || type == SDL_MOUSEBUTTONUP;
+}
+
+void writeEvent(SDL_RWops *file, const SDL_Event &e) {
+    SDL_WriteLE32(file, e.type);
+    switch(e.type) {
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            SDL_WriteU8(file, e.key.state);
+            SDL_WriteU8(file, e.key.repeat);
+            SDL_WriteLE32(file, e.key.keysym.scancode);
+            SDL_WriteLE32(file, e.key.keysym.sym);
+            SDL_WriteLE16(file, e.key.keysym.mod);
+            break;
+        case SDL_TEXTINPUT: {
+            Uint8 length = (Uint8)strlen(e.text.text);
+            SDL_WriteU8(file, length);
+            SDL_RWwrite(file, e.text.text, 1, length);
+            break;
+        }
+        case SDL_MOUSEMOTION:
+            SDL_WriteLE32(file, e.motion.state);
+            SDL_WriteLE32(file, e.motion.x);
+            SDL_WriteLE32(file, e.motion.y);
+            SDL_WriteLE32(file, e.motion.xrel);
+            SDL_WriteLE32(file, e.motion.yrel);
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            SDL_WriteU8(file, e.button.button);
+            SDL_WriteU8(file, e.button.state);
+            SDL_WriteU8(file, e.button.clicks);
+            SDL_WriteLE32(file, e.button.x);
+            SDL_WriteLE32(file, e.button.y);
+            break;
+    }
+}
+
+//Lecturas que devuelven false si el fichero se acaba a mitad del valor:
+bool readU8(SDL_RWops *file, Uint8 &value) {
+    return SDL_RWread(file, &value, 1, 1) == 1;
+}
+
+bool readLE16(SDL_RWops *file, Uint16 &value) {
+    if(SDL_RWread(file, &value, sizeof(value), 1) != 1) {
+        return false;
+    }
+    value = SDL_SwapLE16(value);
+    return true;
+}
+
+bool readLE32(SDL_RWops *file, Uint32 &value) {
+    if(SDL_RWread(file, &value, sizeof(value), 1) != 1) {
+        return false;
+    }
+    value = SDL_SwapLE32(value);
+    return true;
+}
+
+//Devuelve false si el evento esta cortado o no es de un tipo que se grabe:
+bool readEvent(SDL_RWops *file, SDL_Event &e) {
+    memset(&e, 0, sizeof(e));
+    if(!readLE32(file, e.type)) {
+        return false;
+    }
+
+    bool success = true;
+    switch(e.type) {
+        case SDL_KEYDOWN:
+        case SDL_KEYUP: {
+            Uint32 scancode = 0;
+            Uint32 sym = 0;
+            success = readU8(file, e.key.state) && readU8(file, e.key.repeat) && readLE32(file, scancode) &&
+                      readLE32(file, sym) && readLE16(file, e.key.keysym.mod);
+            e.key.keysym.scancode = (SDL_Scancode)scancode;
+            e.key.keysym.sym = (SDL_Keycode)sym;
+            break;
+        }
+        case SDL_TEXTINPUT: {
+            Uint8 length = 0;
+            success = readU8(file, length) && length < sizeof(e.text.text) && SDL_RWread(file, e.text.text, 1, length) == length;
+            break;
+        }
+        case SDL_MOUSEMOTION: {
+            Uint32 values[4] = {0, 0, 0, 0};
+            success = readLE32(file, e.motion.state) && readLE32(file, values[0]) && readLE32(file, values[1]) &&
+                      readLE32(file, values[2]) && readLE32(file, values[3]);
+            e.motion.x = (Sint32)values[0];
+            e.motion.y = (Sint32)values[1];
+            e.motion.xrel = (Sint32)values[2];
+            e.motion.yrel = (Sint32)values[3];
+            break;
+        }
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP: {
+            Uint32 values[2] = {0, 0};
+            success = readU8(file, e.button.button) && readU8(file, e.button.state) && readU8(file, e.button.clicks) &&
+                      readLE32(file, values[0]) && readLE32(file, values[1]);
+            e.button.x = (Sint32)values[0];
+            e.button.y = (Sint32)values[1];
+            break;
+        }
+        case SDL_QUIT:
+            break;
+        default:
+            success = false;
+            break;
+    }
+    return success;
+}
+
+class EventRecorder {
+    public:
+        ~EventRecorder();
+
+        bool open(std::string path);
+        void close();
+        bool isOpen();
+
+        //Guarda un evento leido en el frame dado, si es de entrada:
+        void record(int frame, const SDL_Event &e);
+
+    private:
+        SDL_RWops *file{nullptr};
+        Uint32 startTime{0};
+};
+
+EventRecorder::~EventRecorder() {
+    close();
+}
+
+bool EventRecorder::open(std::string path) {
+    close();
+
+    file = SDL_RWFromFile(path.c_str(), "wb");
+    if(file == nullptr) {
+        cout << SDL_GetError() << endl;
+        return false;
+    }
+
+    SDL_WriteLE32(file, EVENT_LOG_MAGIC);
+    startTime = SDL_GetTicks();
+
+    return true;
+}
+
+void EventRecorder::close() {
+    if(file != nullptr) {
+        SDL_RWclose(file);
+        file = nullptr;
+    }
+}
+
+bool EventRecorder::isOpen() {
+    return file != nullptr;
+}
+
+void EventRecorder::record(int frame, const SDL_Event &e) {
+    if(file == nullptr || !isRecordable(e.type)) {
+        return;
+    }
+
+    SDL_WriteLE32(file, frame);
+    SDL_WriteLE32(file, SDL_GetTicks() - startTime);
+    writeEvent(file, e);
+}
+
+class EventReplayer {
+    public:
+        //Con fast los eventos se meten sin esperar, para ir lo mas rapido posible:
+        bool open(std::string path, bool fast);
+        void close();
+        bool isOpen();
+        bool isFinished();
+
+        //Anade a events los eventos grabados hasta este frame. No pasan por la
+        //cola de SDL para no mezclarse con la entrada real:
+        void takeEvents(int frame, vector<SDL_Event> &events);
+
+    private:
+        struct RecordedEvent {
+            Uint32 frame;
+            Uint32 time;
+            SDL_Event event;
+        };
+
+        vector<RecordedEvent> events;
+        size_t next{0};
+        bool loaded{false};
+        bool fast{false};
+        Uint32 startTime{0};
+};
+
+bool EventReplayer::open(std::string path, bool fast) {
+    close();
+
+    SDL_RWops *file = SDL_RWFromFile(path.c_str(), "rb");
+    if(file == nullptr) {
+        cout << SDL_GetError() << endl;
+        return false;
+    }
+
+    Uint32 magic = 0;
+    if(!readLE32(file, magic) || magic != EVENT_LOG_MAGIC) {
+        cout << "El archivo " << path << " no es una grabacion de eventos" << endl;
+        SDL_RWclose(file);
+        return false;
+    }
+
+    //Si la grabacion se corto (por ejemplo al matar el programa) se reproduce
+    //hasta el ultimo evento completo y no se mete nada a medio leer:
+    RecordedEvent recorded;
+    while(readLE32(file, recorded.frame)) {
+        if(!readLE32(file, recorded.time) || !readEvent(file, recorded.event)) {
+            cout << "La grabacion " << path << " esta cortada, se para en el evento " << events.size() << endl;
+            break;
+        }
+        events.push_back(recorded);
+    }
+    SDL_RWclose(file);
+
+    next = 0;
+    loaded = true;
+    this->fast = fast;
+    startTime = SDL_GetTicks();
+
+    return true;
+}
+
+void EventReplayer::close() {
+    events.clear();
+    next = 0;
+    loaded = false;
+}
+
+bool EventReplayer::isOpen() {
+    return loaded;
+}
+
+bool EventReplayer::isFinished() {
+    return next >= events.size();
+}
+
+void EventReplayer::takeEvents(int frame, vector<SDL_Event> &events) {
+    while(next < this->events.size() && this->events[next].frame <= (Uint32)frame) {
+        //A velocidad real se espera a que llegue el momento en que se grabo:
+        if(!fast) {
+            Uint32 elapsed = SDL_GetTicks() - startTime;
+            if(elapsed < this->events[next].time) {
+                SDL_Delay(this->events[next].time - elapsed);
+            }
+        }
+
+        events.push_back(this->events[next].event);
+        next++;
+    }
+}
+
+EventRecorder recorder;
+EventReplayer replayer;
+
 class Texture {
     public:
+        Texture() = default;
         ~Texture();
 
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
+
         bool loadFromFile(string path);
         void free();
         void render(int x, int y, SDL_Rect *clip = NULL);
 
         int getWidth();
         int getHeight();
+
+        //True si la region (o toda la textura) no tiene ningun pixel transparente:
+        bool isOpaque(SDL_Rect *clip = NULL);
     private:
-        SDL_Texture *texture;
+        SDL_Texture *texture{nullptr};
         int width{0};
         int height{0};
+
+        //Clasificacion hecha al cargar: totalmente opaca, o tabla de sumas de pixeles transparentes:
+        bool opaque{false};
+        std::vector<int> transparentSum;
+        //Blend mode puesto ahora mismo en la textura, para no repetir la llamada:
+        SDL_BlendMode blendMode{SDL_BLENDMODE_BLEND};
 };
 
 Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(width, other.width);
+    swap(height, other.height);
+    swap(opaque, other.opaque);
+    swap(transparentSum, other.transparentSum);
+    swap(blendMode, other.blendMode);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(width, other.width);
+        swap(height, other.height);
+        swap(opaque, other.opaque);
+        swap(transparentSum, other.transparentSum);
+        swap(blendMode, other.blendMode);
+    }
+    return *this;
+}
+
 bool Texture::loadFromFile(string path) {
     SDL_Surface *surf = IMG_Load(path.c_str());
     if(surf == nullptr) {
         cout << SDL_GetError() << endl;
     } else {
         free();
-        SDL_SetColorKey(surf, SDL_TRUE, SDL_MapRGB(surf->format, 0, 0xFF, 0xFF));
-        texture = SDL_CreateTextureFromSurface(renderer, surf);
-        if(texture == nullptr) {
+        //Pasamos a RGBA para poder mirar el alpha de cada pixel:
+        SDL_Surface *formattedSurface = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_RGBA8888, 0);
+        if(formattedSurface == nullptr) {
             cout << SDL_GetError() << endl;
         } else {
-            width = surf->w;
-            height = surf->h;
+            int w = formattedSurface->w;
+            int h = formattedSurface->h;
+            Uint32 colorKey = SDL_MapRGB(formattedSurface->format, 0, 0xFF, 0xFF);
+            Uint32 transparent = SDL_MapRGBA(formattedSurface->format, 0xFF, 0xFF, 0xFF, 0x00);
+            Uint32 alphaMask = formattedSurface->format->Amask;
+
+            //El color key pasa a alpha 0 y contamos los pixeles no opacos en una tabla de sumas:
+            transparentSum.assign((w + 1) * (h + 1), 0);
+            for(int y = 0; y < h; y++) {
+                Uint32 *row = (Uint32*)((Uint8*)formattedSurface->pixels + y * formattedSurface->pitch);
+                int rowCount = 0;
+                for(int x = 0; x < w; x++) {
+                    if(row[x] == colorKey) {
+                        row[x] = transparent;
+                    }
+                    if((row[x] & alphaMask) != alphaMask) {
+                        rowCount++;
+                    }
+                    transparentSum[(y + 1) * (w + 1) + x + 1] = transparentSum[y * (w + 1) + x + 1] + rowCount;
+                }
+            }
+
+            texture = SDL_CreateTextureFromSurface(renderer, formattedSurface);
+            if(texture == nullptr) {
+                cout << SDL_GetError() << endl;
+            } else {
+                width = w;
+                height = h;
+
+                //Si no hay ningun pixel transparente no hace falta la tabla ni el blending:
+                opaque = transparentSum.back() == 0;
+                if(opaque) {
+                    std::vector<int>().swap(transparentSum);
+                }
+                blendMode = opaque ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND;
+                SDL_SetTextureBlendMode(texture, blendMode);
+            }
+            SDL_FreeSurface(formattedSurface);
         }
         SDL_FreeSurface(surf);
     }
     return texture != nullptr;
 }
 
+bool Texture::isOpaque(SDL_Rect *clip) {
+    if(opaque || clip == nullptr || transparentSum.empty()) {
+        return opaque;
+    }
+
+    //Pixeles transparentes dentro del recorte, en tiempo constante:
+    int x1 = clip->x;
+    int y1 = clip->y;
+    int x2 = clip->x + clip->w;
+    int y2 = clip->y + clip->h;
+    if(x1 < 0 || y1 < 0 || x2 > width || y2 > height) {
+        return false;
+    }
+    int stride = width + 1;
+    int count = transparentSum[y2 * stride + x2] - transparentSum[y1 * stride + x2] - transparentSum[y2 * stride + x1] + transparentSum[y1 * stride + x1];
+    return count == 0;
+}
+
 void Texture::free() {
     if(texture != nullptr) {
         SDL_DestroyTexture(texture);
+        texture = nullptr;
         width = 0;
         height = 0;
     }
+    opaque = false;
+    transparentSum.clear();
 }
 
 void Texture::render(int x, int y, SDL_Rect *clip) {
@@ -96,6 +532,13 @@ void Texture::render(int x, int y, SDL_Rect *clip) {
         rect.w = clip->w;
         rect.h = clip->h;
     }
+
+    //Las regiones opacas se dibujan sin blending, que es mucho mas barato en software:
+    SDL_BlendMode mode = isOpaque(clip) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND;
+    if(mode != blendMode) {
+        SDL_SetTextureBlendMode(texture, mode);
+        blendMode = mode;
+    }
     SDL_RenderCopy(renderer, texture, clip, &rect);
 }
 
@@ -220,6 +663,11 @@ void Dot::render(SDL_Rect &camera) {
 bool init() {
     bool success = true;
 
+    //En modo headless no hay pantalla, usamos el driver dummy:
+    if(headless) {
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    }
+
     if(SDL_Init(SDL_INIT_VIDEO) < 0) {
         cout << SDL_GetError() << endl;
         success = false;
@@ -229,7 +677,7 @@ bool init() {
             cout << SDL_GetError() << endl;
             success = false;
         } else {
-            renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+            renderer = SDL_CreateRenderer(window, -1, headless ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
             if(renderer == nullptr) {
                 cout << SDL_GetError() << endl;
                 success = false;
@@ -254,7 +702,7 @@ bool setTiles(Tile *tiles[]) {
 
     std::ifstream map("assets/lesson39/lazy.map");
 
-    if(map == nullptr) {
+    if(map.fail()) {
         cout << "No se ha podido cargar el mapa" << endl;
         success = false;
     } else {
@@ -376,6 +824,9 @@ void close(Tile *tiles[]) {
     dotTexture.free();
     tileTexture.free();
 
+    recorder.close();
+    replayer.close();
+
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
 
@@ -383,7 +834,11 @@ void close(Tile *tiles[]) {
     SDL_Quit();
 }
 
+//benchmark.cpp incluye este archivo para medir el mapa de tiles y las colisiones, sin su main:
+#ifndef LESSON_NO_MAIN
 int main(int argc, char* argv[]) {
+    parseArgs(argc, argv);
+
     Tile *tiles[TOTAL_TILES];
     if(init()) {
         if(loadMedia(tiles)) {
@@ -391,13 +846,41 @@ int main(int argc, char* argv[]) {
             SDL_Event e;
             Dot dot;
             SDL_Rect camera = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+            //Grabacion o reproduccion de la entrada si se pidio:
+            if(!recordPath.empty() && !recorder.open(recordPath)) {
+                quit = true;
+            }
+            if(!replayPath.empty() && !replayer.open(replayPath, replayFast)) {
+                quit = true;
+            }
+
+            //Entrada de cada frame: la grabada si se reproduce y la que llega de SDL:
+            vector<SDL_Event> input;
+
+            //Contador de frames y tiempo para el modo headless:
+            int frame = 0;
+            Uint64 startCounter = SDL_GetPerformanceCounter();
             while(!quit) {
+                if(replayer.isOpen()) {
+                    replayer.takeEvents(frame, input);
+                } else if(headless) {
+                    pushScriptedInput(frame);
+                }
                 while(SDL_PollEvent(&e)) {
-                    if(e.type == SDL_QUIT) {
+                    //Al reproducir solo cuenta la entrada grabada, salvo cerrar la ventana:
+                    if(replayer.isOpen() && isRecordable(e.type) && e.type != SDL_QUIT) {
+                        continue;
+                    }
+                    input.push_back(e);
+                }
+                for(unsigned int i = 0; i < input.size(); i++) {
+                    recorder.record(frame, input[i]);
+                    if(input[i].type == SDL_QUIT) {
                         quit = true;
                     }
-                    dot.handleEvent(e);
+                    dot.handleEvent(input[i]);
                 }
+                input.clear();
                 //Movemos el punto y la camara:
                 dot.move(tiles);
                 dot.setCamera(camera);
@@ -413,9 +896,16 @@ int main(int argc, char* argv[]) {
                 dot.render(camera);
 
                 SDL_RenderPresent(renderer);
+
+                frame++;
+                if(headless && frame >= headlessFrames) {
+                    reportFrames(frame, SDL_GetPerformanceCounter() - startCounter);
+                    quit = true;
+                }
             }
         }
     }
     close(tiles);
     return 0;
 }
+#endif
@@ -1,6 +1,7 @@
 #include <SDL.h>
 #include <SDL_image.h>
 #include <string>
+#include <utility>
 #include <cstring>
 #include <iostream>
 using namespace std;
@@ -13,8 +14,15 @@ SDL_Window *window;
 
 class Texture {
     public:
+        Texture() = default;
         ~Texture();
 
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
+
         bool loadFromFile(string path);
         void free();
         void render(int x, int y, SDL_Rect *clip = NULL);
@@ -28,9 +36,9 @@ class Texture {
         void *getPixels();
         int getPitch();
     private:
-        SDL_Texture *texture;
-        void *pixels;
-        int pitch;
+        SDL_Texture *texture{nullptr};
+        void *pixels{nullptr};
+        int pitch{0};
 
         int width{0};
         int height{0};
@@ -40,6 +48,27 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(pixels, other.pixels);
+    swap(pitch, other.pitch);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(pixels, other.pixels);
+        swap(pitch, other.pitch);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 bool Texture::loadFromFile(string path) {
     SDL_Surface *surf = IMG_Load(path.c_str());
     if(surf == nullptr) {
@@ -47,7 +76,6 @@ bool Texture::loadFromFile(string path) {
     } else {
         free();
         SDL_Surface *formattedSurface = SDL_ConvertSurface(surf, SDL_GetWindowSurface(window)->format, 0);
-        texture = SDL_CreateTextureFromSurface(renderer, surf);
         if(formattedSurface == nullptr) {
             cout << SDL_GetError() << endl;
         } else {
@@ -78,6 +106,7 @@ bool Texture::loadFromFile(string path) {
 void Texture::free() {
     if(texture != nullptr) {
         SDL_DestroyTexture(texture);
+        texture = nullptr;
         width = 0;
         height = 0;
     }
@@ -1,7 +1,13 @@
 #include <SDL.h>
 #include <SDL_image.h>
 #include <string>
+#include <cstdlib>
 #include <cstring>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <map>
+#include <unordered_map>
 #include <iostream>
 using namespace std;
 
@@ -11,13 +17,200 @@ const int SCREEN_HEIGHT = 480;
 SDL_Renderer *renderer;
 SDL_Window *window;
 
+//Modo headless para medir rendimiento sin pantalla: driver de video dummy,
+//renderer software sin vsync y un numero fijo de frames:
+bool headless = false;
+int headlessFrames = 0;
+
+//Lee --headless <frames> de la linea de comandos:
+void parseArgs(int argc, char* argv[]) {
+    for(int i = 1; i < argc; i++) {
+        if(std::string(argv[i]) == "--headless" && i + 1 < argc) {
+            headless = true;
+            headlessFrames = atoi(argv[++i]);
+        }
+    }
+}
+
+//Imprime los frames por segundo al acabar:
+void reportFrames(int frames, Uint64 elapsed) {
+    double seconds = (double)elapsed / SDL_GetPerformanceFrequency();
+    cout << "frames: " << frames << ", segundos: " << seconds << ", fps: " << (seconds > 0 ? frames / seconds : 0) << endl;
+}
+
+//Sitio de creacion de un recurso como "archivo:linea":
+#define RESOURCE_SITE_LINE(line) #line
+#define RESOURCE_SITE_STRING(line) RESOURCE_SITE_LINE(line)
+#define RESOURCE_SITE __FILE__ ":" RESOURCE_SITE_STRING(__LINE__)
+
+//Lleva la cuenta de las texturas y superficies vivas creadas con los helpers
+//de abajo: tamano, formato, bytes y donde se crearon. Sirve para ver la
+//memoria residente en cada momento y las fugas al cerrar:
+class ResourceTracker {
+    public:
+        ResourceTracker();
+
+        void trackTexture(SDL_Texture *texture, const char *site);
+        void untrackTexture(SDL_Texture *texture);
+        void trackSurface(SDL_Surface *surface, const char *site);
+        void untrackSurface(SDL_Surface *surface);
+
+        size_t getResidentBytes();
+        size_t getPeakBytes();
+        size_t getTextureCount();
+        size_t getSurfaceCount();
+
+        //Imprime lo que sigue vivo y devuelve cuantos recursos son:
+        size_t reportLeaks();
+
+    private:
+        struct Resource {
+            int width;
+            int height;
+            Uint32 format;
+            size_t bytes;
+            const char *site;
+        };
+
+        void add(std::unordered_map<const void*, Resource> &resources, const void *handle, Resource resource);
+        void remove(std::unordered_map<const void*, Resource> &resources, const void *handle);
+
+        std::unordered_map<const void*, Resource> textures;
+        std::unordered_map<const void*, Resource> surfaces;
+        size_t residentBytes;
+        size_t peakBytes;
+};
+
+ResourceTracker::ResourceTracker() {
+    residentBytes = 0;
+    peakBytes = 0;
+}
+
+void ResourceTracker::trackTexture(SDL_Texture *texture, const char *site) {
+    if(texture == nullptr) {
+        return;
+    }
+
+    Resource resource = {0, 0, 0, 0, site};
+    SDL_QueryTexture(texture, &resource.format, nullptr, &resource.width, &resource.height);
+    resource.bytes = (size_t)resource.width * resource.height * SDL_BYTESPERPIXEL(resource.format);
+    add(textures, texture, resource);
+}
+
+void ResourceTracker::untrackTexture(SDL_Texture *texture) {
+    remove(textures, texture);
+}
+
+void ResourceTracker::trackSurface(SDL_Surface *surface, const char *site) {
+    if(surface == nullptr) {
+        return;
+    }
+
+    Resource resource = {surface->w, surface->h, surface->format->format, (size_t)surface->pitch * surface->h, site};
+    add(surfaces, surface, resource);
+}
+
+void ResourceTracker::untrackSurface(SDL_Surface *surface) {
+    remove(surfaces, surface);
+}
+
+void ResourceTracker::add(std::unordered_map<const void*, Resource> &resources, const void *handle, Resource resource) {
+    resources[handle] = resource;
+    residentBytes += resource.bytes;
+    peakBytes = max(peakBytes, residentBytes);
+}
+
+void ResourceTracker::remove(std::unordered_map<const void*, Resource> &resources, const void *handle) {
+    std::unordered_map<const void*, Resource>::iterator found = resources.find(handle);
+    if(found != resources.end()) {
+        residentBytes -= found->second.bytes;
+        resources.erase(found);
+    }
+}
+
+size_t ResourceTracker::getResidentBytes() {
+    return residentBytes;
+}
+
+size_t ResourceTracker::getPeakBytes() {
+    return peakBytes;
+}
+
+size_t ResourceTracker::getTextureCount() {
+    return textures.size();
+}
+
+size_t ResourceTracker::getSurfaceCount() {
+    return surfaces.size();
+}
+
+size_t ResourceTracker::reportLeaks() {
+    for(std::unordered_map<const void*, Resource>::iterator i = textures.begin(); i != textures.end(); ++i) {
+        cout << "Textura sin liberar de " << i->second.width << "x" << i->second.height << " " << SDL_GetPixelFormatName(i->second.format) << " (" << i->second.bytes << " bytes) creada en " << i->second.site << endl;
+    }
+    for(std::unordered_map<const void*, Resource>::iterator i = surfaces.begin(); i != surfaces.end(); ++i) {
+        cout << "Superficie sin liberar de " << i->second.width << "x" << i->second.height << " " << SDL_GetPixelFormatName(i->second.format) << " (" << i->second.bytes << " bytes) creada en " << i->second.site << endl;
+    }
+    return textures.size() + surfaces.size();
+}
+
+ResourceTracker resources;
+
+//Helpers para crear y destruir recursos pasando por el tracker:
+SDL_Texture *createTexture(Uint32 format, int access, int w, int h, const char *site) {
+    SDL_Texture *texture = SDL_CreateTexture(renderer, format, access, w, h);
+    resources.trackTexture(texture, site);
+    return texture;
+}
+
+void destroyTexture(SDL_Texture *texture) {
+    if(texture != nullptr) {
+        resources.untrackTexture(texture);
+        SDL_DestroyTexture(texture);
+    }
+}
+
+SDL_Surface *loadSurface(std::string path, const char *site) {
+    SDL_Surface *surface = IMG_Load(path.c_str());
+    resources.trackSurface(surface, site);
+    return surface;
+}
+
+SDL_Surface *convertSurface(SDL_Surface *surface, Uint32 format, const char *site) {
+    SDL_Surface *converted = SDL_ConvertSurfaceFormat(surface, format, 0);
+    resources.trackSurface(converted, site);
+    return converted;
+}
+
+void freeSurface(SDL_Surface *surface) {
+    if(surface != nullptr) {
+        resources.untrackSurface(surface);
+        SDL_FreeSurface(surface);
+    }
+}
+
+//Memoria residente para el titulo de la ventana:
+string describeResources() {
+    return to_string(resources.getTextureCount()) + " texturas, " + to_string(resources.getSurfaceCount()) + " superficies, " +
+           to_string(resources.getResidentBytes() / 1024) + " KB residentes (pico " + to_string(resources.getPeakBytes() / 1024) + " KB)";
+}
+
 class Texture {
     public:
+        Texture() = default;
         ~Texture();
 
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
+
         bool loadFromFile(string path);
         void free();
         void render(int x, int y, SDL_Rect *clip = NULL);
+        //Renderiza una malla de triangulos con la textura en una sola llamada:
+        void renderGeometry(const SDL_Vertex *vertices, int numVertices, const int *indices, int numIndices);
 
         int getWidth();
         int getHeight();
@@ -29,9 +222,9 @@ class Texture {
         int getPitch();
         Uint32 getPixel32(unsigned int x, unsigned int y);
     private:
-        SDL_Texture *texture;
-        void *pixels;
-        int pitch;
+        SDL_Texture *texture{nullptr};
+        void *pixels{nullptr};
+        int pitch{0};
 
         int width{0};
         int height{0};
@@ -41,18 +234,38 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(pixels, other.pixels);
+    swap(pitch, other.pitch);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(pixels, other.pixels);
+        swap(pitch, other.pitch);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 bool Texture::loadFromFile(string path) {
-    SDL_Surface *surf = IMG_Load(path.c_str());
+    SDL_Surface *surf = loadSurface(path, RESOURCE_SITE);
     if(surf == nullptr) {
         cout << SDL_GetError() << endl;
     } else {
         free();
-        SDL_Surface *formattedSurface = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_RGBA8888, 0);
-        texture = SDL_CreateTextureFromSurface(renderer, surf);
+        SDL_Surface *formattedSurface = convertSurface(surf, SDL_PIXELFORMAT_RGBA8888, RESOURCE_SITE);
         if(formattedSurface == nullptr) {
             cout << SDL_GetError() << endl;
         } else {
-            texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, formattedSurface->w, formattedSurface->h);
+            texture = createTexture(SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, formattedSurface->w, formattedSurface->h, RESOURCE_SITE);
             if(texture == nullptr) {
                 cout << SDL_GetError() << endl;
             } else {
@@ -83,10 +296,10 @@ bool Texture::loadFromFile(string path) {
                 SDL_UnlockTexture(texture);
                 pixels = nullptr;
             }
-            SDL_FreeSurface(formattedSurface);
+            freeSurface(formattedSurface);
         }
 
-        SDL_FreeSurface(surf);
+        freeSurface(surf);
     }
 
     return texture != nullptr;
@@ -94,7 +307,8 @@ bool Texture::loadFromFile(string path) {
 
 void Texture::free() {
     if(texture != nullptr) {
-        SDL_DestroyTexture(texture);
+        destroyTexture(texture);
+        texture = nullptr;
         width = 0;
         height = 0;
     }
@@ -109,6 +323,10 @@ void Texture::render(int x, int y, SDL_Rect *clip) {
     SDL_RenderCopy(renderer, texture, clip, &rect);
 }
 
+void Texture::renderGeometry(const SDL_Vertex *vertices, int numVertices, const int *indices, int numIndices) {
+    SDL_RenderGeometry(renderer, texture, vertices, numVertices, indices, numIndices);
+}
+
 bool Texture::lockTexture() {
     bool success = true;
 
@@ -164,27 +382,294 @@ int Texture::getPitch() {
     return pitch;
 }
 
-Texture bitmapTexture;
+//Cada pagina de la fuente cubre 256 code points en una rejilla de 16x16 celdas:
+const Uint32 PAGE_GLYPHS = 256;
+
+//Presupuesto por defecto de memoria de las paginas residentes (16 MB):
+const size_t DEFAULT_PAGE_BUDGET = 16*1024*1024;
 
 class BitmapFont {
     public:
-        //Genera la fuente:
-        bool buildFont(Texture *bitmap);
+        ~BitmapFont();
+
+        //Registra la hoja de glifos de una pagina, se carga la primera vez que se usa:
+        void addPage(Uint32 page, std::string path);
+        //Fuerza la carga de una pagina registrada:
+        bool preloadPage(Uint32 page);
+        //Bytes maximos de textura que pueden estar cargados a la vez:
+        void setMemoryBudget(size_t bytes);
+        //Libera las texturas de todas las paginas:
+        void free();
 
-        //Renderiza el texto:
+        //Un glifo colocado: de que pagina sale, su recorte y su destino:
+        struct GlyphQuad {
+            Uint32 page;
+            SDL_Rect clip;
+            SDL_Rect dest;
+        };
+
+        //Calcula la posicion de cada glifo del texto en UTF-8:
+        void layoutText(int x, int y, const std::string &text, std::vector<GlyphQuad> &quads);
+        //Renderiza el texto en UTF-8:
         void renderText(int x, int y, std::string text);
+
+        //Textura de una pagina, cargandola si se habia descargado:
+        Texture *getPageTexture(Uint32 page);
+
+        //Bytes de textura cargados ahora mismo:
+        size_t getResidentBytes();
     private:
-        //La textura de la fuente:
-        Texture *bitmap;
-        //Los caracteres en la supercicie:
-        SDL_Rect chars[256];
-        //Espaciado:
+        struct FontPage {
+            std::string path;
+            //La textura vive dentro de la pagina, loaded dice si esta cargada:
+            Texture texture;
+            bool loaded{false};
+            bool measured{false};
+            Uint32 lastUsed{0};
+        };
+
+        struct Glyph {
+            SDL_Rect clip;
+            FontPage *page;
+        };
+
+        //Busca el glifo de un code point, cargando su pagina si hace falta:
+        Glyph *getGlyph(Uint32 codePoint);
+        //Carga la textura de la pagina y la mide si es la primera vez:
+        bool loadPage(Uint32 page, FontPage *fontPage);
+        //Libera paginas poco usadas hasta que quepan los bytes pedidos. Las usadas
+        //desde el ultimo layoutText no se tocan aunque haya que pasarse del presupuesto:
+        void evictPages(size_t incomingBytes, FontPage *keep);
+
+        //Escanea la textura en una sola pasada:
+        bool scanFont(Texture *bitmap, SDL_Rect *chars, int &space, int &newLine);
+        //Lectura y escritura del fichero de metricas:
+        //Las metricas son validas solo para una hoja con el mismo tamano y contenido:
+        bool loadMetrics(std::string path, int sheetW, int sheetH, Uint64 sheetHash, SDL_Rect *chars, int &space, int &newLine);
+        void saveMetrics(std::string path, int sheetW, int sheetH, Uint64 sheetHash, SDL_Rect *chars, int space, int newLine);
+
+        //Paginas registradas y glifos ya medidos, solo de las paginas usadas:
+        std::map<Uint32, FontPage> pages;
+        std::unordered_map<Uint32, Glyph> glyphs;
+
+        size_t memoryBudget{DEFAULT_PAGE_BUDGET};
+        size_t residentBytes{0};
+        Uint32 useCounter{0};
+        //Valor de useCounter al empezar el ultimo layoutText (ninguno todavia):
+        Uint32 layoutStart{0xFFFFFFFF};
+
+        //Espaciado, tomado de la primera pagina medida:
+        bool hasSpacing{false};
         int newLine{0};
         int space{0};
 
 };
 
-bool BitmapFont::buildFont(Texture *bitmap) {
+//Cabecera del fichero de metricas ("BMF2"), los "BMF1" sin hash se vuelven a medir:
+const Uint32 METRICS_MAGIC = 0x32464D42;
+
+//Hash FNV-1a de un fichero, para saber si la hoja ha cambiado desde que se midio:
+Uint64 hashFile(std::string path) {
+    Uint64 hash = 14695981039346656037ULL;
+    SDL_RWops *file = SDL_RWFromFile(path.c_str(), "rb");
+    if(file != nullptr) {
+        Uint8 chunk[4096];
+        size_t count = 0;
+        while((count = SDL_RWread(file, chunk, 1, sizeof(chunk))) > 0) {
+            for(size_t i = 0; i < count; i++) {
+                hash ^= chunk[i];
+                hash *= 1099511628211ULL;
+            }
+        }
+        SDL_RWclose(file);
+    }
+    return hash;
+}
+
+//Primer y ultimo bit activo de una mascara de bits, -1 si esta vacia:
+int firstBit(const std::vector<Uint32> &mask) {
+    for(unsigned int word = 0; word < mask.size(); word++) {
+        if(mask[word] != 0) {
+            for(int bit = 0; bit < 32; bit++) {
+                if(mask[word] & (1u << bit)) {
+                    return word * 32 + bit;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+int lastBit(const std::vector<Uint32> &mask) {
+    for(int word = mask.size() - 1; word >= 0; word--) {
+        if(mask[word] != 0) {
+            for(int bit = 31; bit >= 0; bit--) {
+                if(mask[word] & (1u << bit)) {
+                    return word * 32 + bit;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+//Decodifica el siguiente code point UTF-8 y avanza el indice, U+FFFD si es invalido:
+Uint32 nextCodePoint(const std::string &text, unsigned int &i) {
+    Uint8 lead = (Uint8)text[i++];
+    int extra = 0;
+    Uint32 codePoint = lead;
+    //Menor valor que se puede escribir con esa longitud, por debajo es una forma sobrelarga:
+    Uint32 minimum = 0;
+
+    if(lead < 0x80) {
+        return codePoint;
+    } else if(lead < 0xC0 || lead >= 0xF8) {
+        //Byte de continuacion suelto o cabecera que no existe en UTF-8:
+        return 0xFFFD;
+    } else if(lead >= 0xF0) {
+        extra = 3;
+        codePoint = lead & 0x07;
+        minimum = 0x10000;
+    } else if(lead >= 0xE0) {
+        extra = 2;
+        codePoint = lead & 0x0F;
+        minimum = 0x800;
+    } else {
+        extra = 1;
+        codePoint = lead & 0x1F;
+        minimum = 0x80;
+    }
+
+    for(int n = 0; n < extra; n++) {
+        if(i >= text.length() || ((Uint8)text[i] & 0xC0) != 0x80) {
+            return 0xFFFD;
+        }
+        codePoint = (codePoint << 6) | ((Uint8)text[i++] & 0x3F);
+    }
+
+    //Formas sobrelargas (C0 80), surrogates (ED A0 80) y valores fuera de Unicode:
+    if(codePoint < minimum || (codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF) {
+        return 0xFFFD;
+    }
+    return codePoint;
+}
+
+BitmapFont::~BitmapFont() {
+    free();
+}
+
+void BitmapFont::addPage(Uint32 page, std::string path) {
+    pages[page].path = path;
+}
+
+bool BitmapFont::preloadPage(Uint32 page) {
+    auto pageIt = pages.find(page);
+    if(pageIt == pages.end()) {
+        return false;
+    }
+    return pageIt->second.loaded || loadPage(page, &pageIt->second);
+}
+
+void BitmapFont::setMemoryBudget(size_t bytes) {
+    memoryBudget = bytes;
+    evictPages(0, nullptr);
+}
+
+void BitmapFont::free() {
+    for(auto &entry : pages) {
+        entry.second.texture.free();
+        entry.second.loaded = false;
+    }
+    residentBytes = 0;
+}
+
+size_t BitmapFont::getResidentBytes() {
+    return residentBytes;
+}
+
+BitmapFont::Glyph *BitmapFont::getGlyph(Uint32 codePoint) {
+    Uint32 page = codePoint / PAGE_GLYPHS;
+    auto pageIt = pages.find(page);
+    if(pageIt == pages.end()) {
+        return nullptr;
+    }
+
+    FontPage *fontPage = &pageIt->second;
+    if(!fontPage->loaded && !loadPage(page, fontPage)) {
+        return nullptr;
+    }
+    fontPage->lastUsed = ++useCounter;
+
+    auto glyphIt = glyphs.find(codePoint);
+    return glyphIt != glyphs.end() ? &glyphIt->second : nullptr;
+}
+
+bool BitmapFont::loadPage(Uint32 page, FontPage *fontPage) {
+    Texture texture;
+    if(!texture.loadFromFile(fontPage->path)) {
+        return false;
+    }
+
+    //Las metricas se quedan en el indice aunque la pagina se descargue:
+    if(!fontPage->measured) {
+        SDL_Rect chars[PAGE_GLYPHS];
+        int pageSpace = 0;
+        int pageNewLine = 0;
+
+        //El fichero de metricas va junto a la hoja de glifos:
+        std::string metricsPath = fontPage->path.substr(0, fontPage->path.find_last_of('.')) + ".metrics";
+        Uint64 sheetHash = hashFile(fontPage->path);
+        if(!loadMetrics(metricsPath, texture.getWidth(), texture.getHeight(), sheetHash, chars, pageSpace, pageNewLine)) {
+            if(!scanFont(&texture, chars, pageSpace, pageNewLine)) {
+                return false;
+            }
+            saveMetrics(metricsPath, texture.getWidth(), texture.getHeight(), sheetHash, chars, pageSpace, pageNewLine);
+        }
+
+        for(Uint32 i = 0; i < PAGE_GLYPHS; i++) {
+            Glyph glyph = {chars[i], fontPage};
+            glyphs[page * PAGE_GLYPHS + i] = glyph;
+        }
+        if(!hasSpacing || page == 0) {
+            space = pageSpace;
+            newLine = pageNewLine;
+            hasSpacing = true;
+        }
+        fontPage->measured = true;
+    }
+
+    size_t bytes = (size_t)texture.getWidth() * texture.getHeight() * 4;
+    evictPages(bytes, fontPage);
+    //Se mueve a la pagina sin recargarla:
+    fontPage->texture = std::move(texture);
+    fontPage->loaded = true;
+    residentBytes += bytes;
+
+    return true;
+}
+
+void BitmapFont::evictPages(size_t incomingBytes, FontPage *keep) {
+    while(residentBytes + incomingBytes > memoryBudget) {
+        //Buscamos la pagina cargada que lleva mas tiempo sin usarse:
+        FontPage *oldest = nullptr;
+        for(auto &entry : pages) {
+            FontPage *candidate = &entry.second;
+            bool pinned = candidate == keep || candidate->lastUsed >= layoutStart;
+            if(!pinned && candidate->loaded && (oldest == nullptr || candidate->lastUsed < oldest->lastUsed)) {
+                oldest = candidate;
+            }
+        }
+        if(oldest == nullptr) {
+            break;
+        }
+
+        residentBytes -= (size_t)oldest->texture.getWidth() * oldest->texture.getHeight() * 4;
+        oldest->texture.free();
+        oldest->loaded = false;
+    }
+}
+
+bool BitmapFont::scanFont(Texture *bitmap, SDL_Rect *chars, int &space, int &newLine) {
     bool success = true;
 
     if(!bitmap->lockTexture()) {
@@ -201,83 +686,65 @@ bool BitmapFont::buildFont(Texture *bitmap) {
         int top = cellH;
         int baseA = cellH;
 
-        int currentChar = 0;
+        //Mascaras de ocupacion de columnas y filas para cada celda de una fila:
+        std::vector<std::vector<Uint32>> colMask(16, std::vector<Uint32>((cellW + 31)/32));
+        std::vector<std::vector<Uint32>> rowMask(16, std::vector<Uint32>((cellH + 31)/32));
+
+        Uint32 *pixelsInteger = (Uint32*)bitmap->getPixels();
+        int pixelsPerRow = bitmap->getPitch()/4;
 
         for(int rows = 0; rows < 16; rows++) {
             for(int cols = 0; cols < 16; cols++) {
-                //Offset:
-                chars[currentChar].x = cellW * cols;
-                chars[currentChar].y = cellH * rows;
-
-                //Dimensiones:
-                chars[currentChar].w = cellW;
-                chars[currentChar].h = cellH;
-
-                //Buscamos el lado izquierdo:
-                for(int pCol = 0; pCol < cellW; pCol++) {
-                    for(int pRow = 0; pRow < cellH; pRow++) {
-                        int pX = (cellW * cols) + pCol;
-                        int pY = (cellH * rows) + pRow;
-
-                        if(bitmap->getPixel32(pX, pY) != bgColor) {
-                            chars[currentChar].x = pX;
+                std::fill(colMask[cols].begin(), colMask[cols].end(), 0);
+                std::fill(rowMask[cols].begin(), rowMask[cols].end(), 0);
+            }
 
-                            pCol = cellW;
-                            pRow = cellH;
+            //Recorremos la fila de celdas una sola vez, linea a linea:
+            for(int pRow = 0; pRow < cellH; pRow++) {
+                Uint32 *line = pixelsInteger + (cellH * rows + pRow) * pixelsPerRow;
+                for(int cols = 0; cols < 16; cols++) {
+                    Uint32 *cell = line + cellW * cols;
+                    std::vector<Uint32> &cMask = colMask[cols];
+                    bool rowUsed = false;
+                    for(int pCol = 0; pCol < cellW; pCol++) {
+                        if(cell[pCol] != bgColor) {
+                            cMask[pCol/32] |= 1u << (pCol%32);
+                            rowUsed = true;
                         }
                     }
-                }
-
-                //Buscamos el lado derecho:
-                for(int pColW = cellW - 1; pColW >= 0; pColW--) {
-                    for(int pRowW = 0; pRowW < cellH; pRowW++) {
-                        int pX = (cellW * cols) + pColW;
-                        int pY = (cellH * rows) + pRowW;
-
-                        if(bitmap->getPixel32(pX, pY) != bgColor) {
-                            chars[currentChar].w = pX - chars[currentChar].x + 1;
-
-                            pColW = -1;
-                            pRowW = cellH;
-                        }
+                    if(rowUsed) {
+                        rowMask[cols][pRow/32] |= 1u << (pRow%32);
                     }
                 }
+            }
 
-                //Buscamos el top:
-                for(int pRow = 0; pRow < cellH; pRow++) {
-                    for(int pCol = 0; pCol < cellW; pCol++) {
-                        int pX = (cellW * cols) + pCol;
-                        int pY = (cellH * rows) + pRow;
-
-                        if(bitmap->getPixel32(pX, pY) != bgColor) {
-                            if(pRow < top) {
-                                top = pRow;
-                            }
+            //Sacamos los limites de cada caracter de las mascaras:
+            for(int cols = 0; cols < 16; cols++) {
+                int currentChar = rows * 16 + cols;
 
-                            pCol = cellW;
-                            pRow = cellH;
-                        }
-                    }
-                }
+                //Offset y dimensiones por defecto (celda vacia):
+                chars[currentChar].x = cellW * cols;
+                chars[currentChar].y = cellH * rows;
+                chars[currentChar].w = cellW;
+                chars[currentChar].h = cellH;
 
-                //Buscamos la parte de abajo de A:
-                if(currentChar == 'A') {
-                    for(int pRow = cellH - 1; pRow >= 0; pRow--) {
-                        for(int pCol = 0; pCol < cellW; pCol++) {
-                            int pX = (cellW * cols) + pCol;
-                            int pY = (cellH * rows) + pRow;
+                int left = firstBit(colMask[cols]);
+                if(left >= 0) {
+                    //Lado izquierdo y derecho:
+                    chars[currentChar].x = cellW * cols + left;
+                    chars[currentChar].w = lastBit(colMask[cols]) - left + 1;
 
-                            if(bitmap->getPixel32(pX, pY) != bgColor) {
-                                baseA = pRow;
+                    //Top:
+                    int charTop = firstBit(rowMask[cols]);
+                    if(charTop < top) {
+                        top = charTop;
+                    }
 
-                                pCol = cellW;
-                                pRow = -1;
-                            }
-                        }
+                    //Parte de abajo de A:
+                    if(currentChar == 'A') {
+                        baseA = lastBit(rowMask[cols]);
                     }
                 }
-
-                currentChar++;
             }
         }
         //Calculamos espacio:
@@ -286,44 +753,244 @@ bool BitmapFont::buildFont(Texture *bitmap) {
         newLine = baseA - top;
 
         //Loop por el exceso de pixeles en top:
-        for(int i = 0; i < 256; i++) {
+        for(Uint32 i = 0; i < PAGE_GLYPHS; i++) {
             chars[i].y += top;
             chars[i].h -= top;
         }
 
         bitmap->unlockTexture();
-        this->bitmap = bitmap;
     }
 
     return success;
 }
 
-void BitmapFont::renderText(int x, int y, std::string text) {
-    if(bitmap != nullptr) {
-        int curX = x;
-        int curY = y;
-        for(unsigned int i = 0; i < text.length(); i++) {
-            if(text[i] == ' ') {
-                curX += space;
-            } else if(text[i] == '\n') {
-                curY += newLine;
-                curX = x;
+bool BitmapFont::loadMetrics(std::string path, int sheetW, int sheetH, Uint64 sheetHash, SDL_Rect *chars, int &space, int &newLine) {
+    bool success = false;
+
+    SDL_RWops *file = SDL_RWFromFile(path.c_str(), "rb");
+    if(file != nullptr) {
+        //Comprobamos que las metricas son de esta misma hoja: una hoja editada
+        //con el mismo tamano tiene otro hash:
+        Uint32 magic = 0;
+        Sint32 header[2] = {0, 0};
+        Uint64 hash = 0;
+        SDL_RWread(file, &magic, sizeof(Uint32), 1);
+        SDL_RWread(file, header, sizeof(Sint32), 2);
+        SDL_RWread(file, &hash, sizeof(Uint64), 1);
+        if(magic == METRICS_MAGIC && header[0] == sheetW && header[1] == sheetH && hash == sheetHash) {
+            Sint32 metrics[2];
+            if(SDL_RWread(file, metrics, sizeof(Sint32), 2) == 2 && SDL_RWread(file, chars, sizeof(SDL_Rect), PAGE_GLYPHS) == PAGE_GLYPHS) {
+                space = metrics[0];
+                newLine = metrics[1];
+                success = true;
+            }
+        }
+        SDL_RWclose(file);
+    }
+
+    return success;
+}
+
+void BitmapFont::saveMetrics(std::string path, int sheetW, int sheetH, Uint64 sheetHash, SDL_Rect *chars, int space, int newLine) {
+    SDL_RWops *file = SDL_RWFromFile(path.c_str(), "w+b");
+    if(file == nullptr) {
+        cout << "No se han podido guardar las metricas: " << SDL_GetError() << endl;
+    } else {
+        Sint32 header[2] = {sheetW, sheetH};
+        Sint32 metrics[2] = {space, newLine};
+        SDL_RWwrite(file, &METRICS_MAGIC, sizeof(Uint32), 1);
+        SDL_RWwrite(file, header, sizeof(Sint32), 2);
+        SDL_RWwrite(file, &sheetHash, sizeof(Uint64), 1);
+        SDL_RWwrite(file, metrics, sizeof(Sint32), 2);
+        SDL_RWwrite(file, chars, sizeof(SDL_Rect), PAGE_GLYPHS);
+        SDL_RWclose(file);
+    }
+}
+
+void BitmapFont::layoutText(int x, int y, const std::string &text, std::vector<GlyphQuad> &quads) {
+    //Las paginas que use este texto quedan fijadas hasta el siguiente layout, para
+    //que un presupuesto justo no las descargue y recargue en el mismo frame:
+    layoutStart = useCounter + 1;
+    int curX = x;
+    int curY = y;
+    unsigned int i = 0;
+    while(i < text.length()) {
+        Uint32 codePoint = nextCodePoint(text, i);
+        if(codePoint == ' ') {
+            curX += space;
+        } else if(codePoint == '\n') {
+            curY += newLine;
+            curX = x;
+        } else {
+            Glyph *glyph = getGlyph(codePoint);
+            if(glyph != nullptr) {
+                GlyphQuad quad = {codePoint / PAGE_GLYPHS, glyph->clip, {curX, curY, glyph->clip.w, glyph->clip.h}};
+                quads.push_back(quad);
+
+                curX += glyph->clip.w +1;
             } else {
-                int ascii = (unsigned char)text[i];
+                //Sin pagina para este code point, dejamos un hueco:
+                curX += space;
+            }
+        }
+    }
+}
+
+void BitmapFont::renderText(int x, int y, std::string text) {
+    std::vector<GlyphQuad> quads;
+    layoutText(x, y, text, quads);
+    for(unsigned int i = 0; i < quads.size(); i++) {
+        Texture *texture = getPageTexture(quads[i].page);
+        if(texture != nullptr) {
+            texture->render(quads[i].dest.x, quads[i].dest.y, &quads[i].clip);
+        }
+    }
+}
+
+Texture *BitmapFont::getPageTexture(Uint32 page) {
+    auto pageIt = pages.find(page);
+    if(pageIt == pages.end()) {
+        return nullptr;
+    }
+
+    FontPage *fontPage = &pageIt->second;
+    if(!fontPage->loaded && !loadPage(page, fontPage)) {
+        return nullptr;
+    }
+    fontPage->lastUsed = ++useCounter;
 
-                bitmap->render(curX, curY, &chars[ascii]);
+    return &fontPage->texture;
+}
+
+//Texto estatico ya maquetado, solo se recalcula cuando cambia la cadena:
+class TextRun {
+    public:
+        TextRun(BitmapFont *font);
+
+        //Cambia el texto, si es el mismo no se hace nada:
+        void setText(std::string text);
+        //Dibuja el texto con una llamada por pagina de la fuente:
+        void render(int x, int y);
+    private:
+        //Los triangulos de todos los glifos que salen de una misma pagina:
+        struct PageBatch {
+            Uint32 page;
+            std::vector<SDL_Vertex> vertices;
+            std::vector<int> indices;
+        };
+
+        void layout();
+
+        BitmapFont *font;
+        std::string text;
+        bool dirty{true};
+        std::vector<PageBatch> batches;
+
+        //Posicion con la que estan calculados los vertices:
+        int originX{0};
+        int originY{0};
+};
+
+TextRun::TextRun(BitmapFont *font) {
+    this->font = font;
+}
 
-                curX += chars[ascii].w +1;
+void TextRun::setText(std::string text) {
+    if(text != this->text) {
+        this->text = text;
+        dirty = true;
+    }
+}
+
+void TextRun::layout() {
+    std::vector<BitmapFont::GlyphQuad> quads;
+    font->layoutText(originX, originY, text, quads);
+
+    batches.clear();
+    SDL_Color white = {0xFF, 0xFF, 0xFF, 0xFF};
+    for(unsigned int i = 0; i < quads.size(); i++) {
+        Texture *texture = font->getPageTexture(quads[i].page);
+        if(texture == nullptr) {
+            continue;
+        }
+
+        //Buscamos el lote de la pagina, casi siempre hay muy pocas:
+        PageBatch *batch = nullptr;
+        for(unsigned int b = 0; b < batches.size(); b++) {
+            if(batches[b].page == quads[i].page) {
+                batch = &batches[b];
+                break;
             }
         }
+        if(batch == nullptr) {
+            batches.push_back(PageBatch());
+            batch = &batches.back();
+            batch->page = quads[i].page;
+        }
+
+        //Coordenadas de textura normalizadas:
+        float texW = (float)texture->getWidth();
+        float texH = (float)texture->getHeight();
+        SDL_Rect &clip = quads[i].clip;
+        SDL_Rect &dest = quads[i].dest;
+        float u0 = clip.x / texW;
+        float v0 = clip.y / texH;
+        float u1 = (clip.x + clip.w) / texW;
+        float v1 = (clip.y + clip.h) / texH;
+
+        int first = batch->vertices.size();
+        SDL_Vertex corners[4] = {
+            {{(float)dest.x, (float)dest.y}, white, {u0, v0}},
+            {{(float)(dest.x + dest.w), (float)dest.y}, white, {u1, v0}},
+            {{(float)(dest.x + dest.w), (float)(dest.y + dest.h)}, white, {u1, v1}},
+            {{(float)dest.x, (float)(dest.y + dest.h)}, white, {u0, v1}}
+        };
+        batch->vertices.insert(batch->vertices.end(), corners, corners + 4);
+        int quadIndices[6] = {first, first + 1, first + 2, first, first + 2, first + 3};
+        batch->indices.insert(batch->indices.end(), quadIndices, quadIndices + 6);
+    }
+
+    dirty = false;
+}
+
+void TextRun::render(int x, int y) {
+    if(dirty) {
+        originX = x;
+        originY = y;
+        layout();
+    } else if(x != originX || y != originY) {
+        //Solo se ha movido, desplazamos los vertices ya calculados:
+        float dx = (float)(x - originX);
+        float dy = (float)(y - originY);
+        for(unsigned int b = 0; b < batches.size(); b++) {
+            for(unsigned int v = 0; v < batches[b].vertices.size(); v++) {
+                batches[b].vertices[v].position.x += dx;
+                batches[b].vertices[v].position.y += dy;
+            }
+        }
+        originX = x;
+        originY = y;
+    }
+
+    for(unsigned int b = 0; b < batches.size(); b++) {
+        Texture *texture = font->getPageTexture(batches[b].page);
+        if(texture != nullptr && !batches[b].indices.empty()) {
+            texture->renderGeometry(&batches[b].vertices[0], batches[b].vertices.size(), &batches[b].indices[0], batches[b].indices.size());
+        }
     }
 }
 
 BitmapFont bitmapFont;
+TextRun bitmapText(&bitmapFont);
 
 bool init() {
     bool success = true;
 
+    //En modo headless no hay pantalla, usamos el driver dummy:
+    if(headless) {
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    }
+
     if(SDL_Init(SDL_INIT_VIDEO) < 0) {
         cout << SDL_GetError() << endl;
         success = false;
@@ -333,7 +1000,7 @@ bool init() {
             cout << SDL_GetError() << endl;
             success = false;
         } else {
-            renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+            renderer = SDL_CreateRenderer(window, -1, headless ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
             if(renderer == nullptr) {
                 cout << SDL_GetError() << endl;
                 success = false;
@@ -353,30 +1020,48 @@ bool init() {
 bool loadMedia() {
     bool success = true;
 
-    if(!bitmapTexture.loadFromFile("assets/lesson41/lazyfont.png")) {
+    //Solo la pagina latina, el resto de paginas se registrarian igual:
+    bitmapFont.addPage(0, "assets/lesson41/lazyfont.png");
+    if(!bitmapFont.preloadPage(0)) {
         success = false;
-    } else {
-        bitmapFont.buildFont(&bitmapTexture);
     }
 
     return success;
 }
 
 void close() {
-    bitmapTexture.free();
+    bitmapFont.free();
 
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
 
+    //Todo lo creado con los helpers deberia estar liberado ya:
+    if(resources.reportLeaks() > 0) {
+        cout << "Memoria sin liberar: " << resources.getResidentBytes() << " bytes" << endl;
+    }
+
     IMG_Quit();
     SDL_Quit();
 }
 
+//benchmark.cpp incluye este archivo para medir la fuente bitmap, sin su main:
+#ifndef LESSON_NO_MAIN
 int main(int argc, char* argv[]) {
+    parseArgs(argc, argv);
+
     if(init()) {
         if(loadMedia()) {
             bool quit = false;
             SDL_Event e;
+
+            //El texto no cambia, se maqueta una sola vez:
+            bitmapText.setText("Bitmap Font:\nABDCEFGHIJKLMNOPQRSTUVWXYZ\nabcdefghijklmnopqrstuvwxyz\n0123456789");
+            //Ultimo titulo puesto con la memoria residente:
+            std::string lastTitle;
+
+            //Contador de frames y tiempo para el modo headless:
+            int frame = 0;
+            Uint64 startCounter = SDL_GetPerformanceCounter();
             while(!quit) {
                 while(SDL_PollEvent(&e)) {
                     if(e.type == SDL_QUIT) {
@@ -388,13 +1073,27 @@ int main(int argc, char* argv[]) {
                 SDL_RenderClear(renderer);
 
                 //Renderizamos la superficie:
-                bitmapFont.renderText(0, 0, "Bitmap Font:\nABDCEFGHIJKLMNOPQRSTUVWXYZ\nabcdefghijklmnopqrstuvwxyz\n0123456789");
+                bitmapText.render(0, 0);
 
                 SDL_RenderPresent(renderer);
+
+                //Memoria residente en el titulo, solo cuando cambia:
+                std::string title = "Bitmap fonts - " + describeResources();
+                if(title != lastTitle) {
+                    SDL_SetWindowTitle(window, title.c_str());
+                    lastTitle = title;
+                }
+
+                frame++;
+                if(headless && frame >= headlessFrames) {
+                    reportFrames(frame, SDL_GetPerformanceCounter() - startCounter);
+                    quit = true;
+                }
             }
         }
     }
     close();
     return 0;
 }
+#endif
 
@@ -1,8 +1,17 @@
 #include <SDL.h>
 #include <SDL_image.h>
 #include <string>
+#include <utility>
+#include <cstdlib>
 #include <cstring>
 #include <sstream>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <iostream>
 using namespace std;
 
@@ -12,11 +21,199 @@ const int SCREEN_HEIGHT = 480;
 SDL_Renderer *renderer;
 SDL_Window *window;
 
+//Modo headless para medir rendimiento sin pantalla: driver de video dummy,
+//renderer software sin vsync y un numero fijo de frames:
+bool headless = false;
+int headlessFrames = 0;
+//Con --bench-queue solo se mide la cola, sin abrir ventana:
+bool benchQueue = false;
+
+//Lee --headless <frames> y --bench-queue de la linea de comandos:
+void parseArgs(int argc, char* argv[]) {
+    for(int i = 1; i < argc; i++) {
+        if(std::string(argv[i]) == "--headless" && i + 1 < argc) {
+            headless = true;
+            headlessFrames = atoi(argv[++i]);
+        } else if(std::string(argv[i]) == "--bench-queue") {
+            benchQueue = true;
+        }
+    }
+}
+
+//Imprime los frames por segundo al acabar:
+void reportFrames(int frames, Uint64 elapsed) {
+    double seconds = (double)elapsed / SDL_GetPerformanceFrequency();
+    cout << "frames: " << frames << ", segundos: " << seconds << ", fps: " << (seconds > 0 ? frames / seconds : 0) << endl;
+}
+
+//Sitio de creacion de un recurso como "archivo:linea":
+#define RESOURCE_SITE_LINE(line) #line
+#define RESOURCE_SITE_STRING(line) RESOURCE_SITE_LINE(line)
+#define RESOURCE_SITE __FILE__ ":" RESOURCE_SITE_STRING(__LINE__)
+
+//Lleva la cuenta de las texturas y superficies vivas creadas con los helpers
+//de abajo: tamano, formato, bytes y donde se crearon. Sirve para ver la
+//memoria residente en cada momento y las fugas al cerrar:
+class ResourceTracker {
+    public:
+        ResourceTracker();
+
+        void trackTexture(SDL_Texture *texture, const char *site);
+        void untrackTexture(SDL_Texture *texture);
+        void trackSurface(SDL_Surface *surface, const char *site);
+        void untrackSurface(SDL_Surface *surface);
+
+        size_t getResidentBytes();
+        size_t getPeakBytes();
+        size_t getTextureCount();
+        size_t getSurfaceCount();
+
+        //Imprime lo que sigue vivo y devuelve cuantos recursos son:
+        size_t reportLeaks();
+
+    private:
+        struct Resource {
+            int width;
+            int height;
+            Uint32 format;
+            size_t bytes;
+            const char *site;
+        };
+
+        void add(std::unordered_map<const void*, Resource> &resources, const void *handle, Resource resource);
+        void remove(std::unordered_map<const void*, Resource> &resources, const void *handle);
+
+        std::unordered_map<const void*, Resource> textures;
+        std::unordered_map<const void*, Resource> surfaces;
+        size_t residentBytes;
+        size_t peakBytes;
+};
+
+ResourceTracker::ResourceTracker() {
+    residentBytes = 0;
+    peakBytes = 0;
+}
+
+void ResourceTracker::trackTexture(SDL_Texture *texture, const char *site) {
+    if(texture == nullptr) {
+        return;
+    }
+
+    Resource resource = {0, 0, 0, 0, site};
+    SDL_QueryTexture(texture, &resource.format, nullptr, &resource.width, &resource.height);
+    resource.bytes = (size_t)resource.width * resource.height * SDL_BYTESPERPIXEL(resource.format);
+    add(textures, texture, resource);
+}
+
+void ResourceTracker::untrackTexture(SDL_Texture *texture) {
+    remove(textures, texture);
+}
+
+void ResourceTracker::trackSurface(SDL_Surface *surface, const char *site) {
+    if(surface == nullptr) {
+        return;
+    }
+
+    Resource resource = {surface->w, surface->h, surface->format->format, (size_t)surface->pitch * surface->h, site};
+    add(surfaces, surface, resource);
+}
+
+void ResourceTracker::untrackSurface(SDL_Surface *surface) {
+    remove(surfaces, surface);
+}
+
+void ResourceTracker::add(std::unordered_map<const void*, Resource> &resources, const void *handle, Resource resource) {
+    resources[handle] = resource;
+    residentBytes += resource.bytes;
+    peakBytes = max(peakBytes, residentBytes);
+}
+
+void ResourceTracker::remove(std::unordered_map<const void*, Resource> &resources, const void *handle) {
+    std::unordered_map<const void*, Resource>::iterator found = resources.find(handle);
+    if(found != resources.end()) {
+        residentBytes -= found->second.bytes;
+        resources.erase(found);
+    }
+}
+
+size_t ResourceTracker::getResidentBytes() {
+    return residentBytes;
+}
+
+size_t ResourceTracker::getPeakBytes() {
+    return peakBytes;
+}
+
+size_t ResourceTracker::getTextureCount() {
+    return textures.size();
+}
+
+size_t ResourceTracker::getSurfaceCount() {
+    return surfaces.size();
+}
+
+size_t ResourceTracker::reportLeaks() {
+    for(std::unordered_map<const void*, Resource>::iterator i = textures.begin(); i != textures.end(); ++i) {
+        cout << "Textura sin liberar de " << i->second.width << "x" << i->second.height << " " << SDL_GetPixelFormatName(i->second.format) << " (" << i->second.bytes << " bytes) creada en " << i->second.site << endl;
+    }
+    for(std::unordered_map<const void*, Resource>::iterator i = surfaces.begin(); i != surfaces.end(); ++i) {
+        cout << "Superficie sin liberar de " << i->second.width << "x" << i->second.height << " " << SDL_GetPixelFormatName(i->second.format) << " (" << i->second.bytes << " bytes) creada en " << i->second.site << endl;
+    }
+    return textures.size() + surfaces.size();
+}
+
+ResourceTracker resources;
+
+//Helpers para crear y destruir recursos pasando por el tracker:
+SDL_Texture *createTexture(Uint32 format, int access, int w, int h, const char *site) {
+    SDL_Texture *texture = SDL_CreateTexture(renderer, format, access, w, h);
+    resources.trackTexture(texture, site);
+    return texture;
+}
+
+void destroyTexture(SDL_Texture *texture) {
+    if(texture != nullptr) {
+        resources.untrackTexture(texture);
+        SDL_DestroyTexture(texture);
+    }
+}
+
+SDL_Surface *loadSurface(std::string path, const char *site) {
+    SDL_Surface *surface = IMG_Load(path.c_str());
+    resources.trackSurface(surface, site);
+    return surface;
+}
+
+SDL_Surface *convertSurface(SDL_Surface *surface, Uint32 format, const char *site) {
+    SDL_Surface *converted = SDL_ConvertSurfaceFormat(surface, format, 0);
+    resources.trackSurface(converted, site);
+    return converted;
+}
+
+void freeSurface(SDL_Surface *surface) {
+    if(surface != nullptr) {
+        resources.untrackSurface(surface);
+        SDL_FreeSurface(surface);
+    }
+}
+
+//Memoria residente para el titulo de la ventana:
+string describeResources() {
+    return to_string(resources.getTextureCount()) + " texturas, " + to_string(resources.getSurfaceCount()) + " superficies, " +
+           to_string(resources.getResidentBytes() / 1024) + " KB residentes (pico " + to_string(resources.getPeakBytes() / 1024) + " KB)";
+}
+
 class Texture {
     public:
+        Texture() = default;
         ~Texture();
 
-        bool createBlank(int w, int h);
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
+
         bool loadFromFile(string path);
         void free();
         void render(int x, int y, SDL_Rect *clip = NULL);
@@ -28,13 +225,12 @@ class Texture {
         bool lockTexture();
         bool unlockTexture();
         void *getPixels();
-        void copyPixels(void *pix);
         int getPitch();
         Uint32 getPixel32(unsigned int x, unsigned int y);
     private:
-        SDL_Texture *texture;
-        void *pixels;
-        int pitch;
+        SDL_Texture *texture{nullptr};
+        void *pixels{nullptr};
+        int pitch{0};
 
         int width{0};
         int height{0};
@@ -44,18 +240,38 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(pixels, other.pixels);
+    swap(pitch, other.pitch);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(pixels, other.pixels);
+        swap(pitch, other.pitch);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 bool Texture::loadFromFile(string path) {
-    SDL_Surface *surf = IMG_Load(path.c_str());
+    SDL_Surface *surf = loadSurface(path, RESOURCE_SITE);
     if(surf == nullptr) {
         cout << SDL_GetError() << endl;
     } else {
         free();
-        SDL_Surface *formattedSurface = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_RGBA8888, 0);
-        texture = SDL_CreateTextureFromSurface(renderer, surf);
+        SDL_Surface *formattedSurface = convertSurface(surf, SDL_PIXELFORMAT_RGBA8888, RESOURCE_SITE);
         if(formattedSurface == nullptr) {
             cout << SDL_GetError() << endl;
         } else {
-            texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, formattedSurface->w, formattedSurface->h);
+            texture = createTexture(SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, formattedSurface->w, formattedSurface->h, RESOURCE_SITE);
             if(texture == nullptr) {
                 cout << SDL_GetError() << endl;
             } else {
@@ -86,10 +302,10 @@ bool Texture::loadFromFile(string path) {
                 SDL_UnlockTexture(texture);
                 pixels = nullptr;
             }
-            SDL_FreeSurface(formattedSurface);
+            freeSurface(formattedSurface);
         }
 
-        SDL_FreeSurface(surf);
+        freeSurface(surf);
     }
 
     return texture != nullptr;
@@ -97,7 +313,8 @@ bool Texture::loadFromFile(string path) {
 
 void Texture::free() {
     if(texture != nullptr) {
-        SDL_DestroyTexture(texture);
+        destroyTexture(texture);
+        texture = nullptr;
         width = 0;
         height = 0;
     }
@@ -167,78 +384,574 @@ int Texture::getPitch() {
     return pitch;
 }
 
-bool Texture::createBlank(int w, int h) {
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, w, h);
-    if(texture == nullptr) {
-        cout << "No se ha podido crear la textura en blanco: " << SDL_GetError() << endl;
-    } else {
+//Textura de streaming con varias texturas en rotacion que solo sube lo que cambia:
+class StreamingTexture {
+    public:
+        StreamingTexture() = default;
+        ~StreamingTexture();
+
+        //Solo se puede mover, igual que Texture: una copia destruiria dos veces las texturas.
+        StreamingTexture(const StreamingTexture &other) = delete;
+        StreamingTexture &operator=(const StreamingTexture &other) = delete;
+        StreamingTexture(StreamingTexture &&other);
+        StreamingTexture &operator=(StreamingTexture &&other);
+
+        //Crea las texturas de la rotacion (2 o 3):
+        bool create(int w, int h, int count = 3);
+        void free();
+
+        //Sube un frame nuevo; dirty es la region que ha cambiado desde el anterior (nullptr = todo):
+        void update(void *pix, int srcPitch, const SDL_Rect *dirty = nullptr);
+        //Renderiza la ultima textura subida:
+        void render(int x, int y);
+
+        int getWidth();
+        int getHeight();
+    private:
+        std::vector<SDL_Texture*> textures;
+        //Region que le falta por actualizar a cada textura de la rotacion:
+        std::vector<SDL_Rect> pending;
+        int current{0};
+
+        int width{0};
+        int height{0};
+};
+
+StreamingTexture::~StreamingTexture() {
+    free();
+}
+
+StreamingTexture::StreamingTexture(StreamingTexture &&other) : StreamingTexture() {
+    swap(textures, other.textures);
+    swap(pending, other.pending);
+    swap(current, other.current);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+StreamingTexture &StreamingTexture::operator=(StreamingTexture &&other) {
+    if(this != &other) {
+        free();
+        swap(textures, other.textures);
+        swap(pending, other.pending);
+        swap(current, other.current);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
+bool StreamingTexture::create(int w, int h, int count) {
+    free();
+
+    bool success = true;
+    for(int i = 0; i < count; i++) {
+        SDL_Texture *texture = createTexture(SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, w, h, RESOURCE_SITE);
+        if(texture == nullptr) {
+            cout << "No se ha podido crear la textura de streaming: " << SDL_GetError() << endl;
+            success = false;
+            break;
+        }
+        textures.push_back(texture);
+
+        //Al principio ninguna tiene contenido:
+        SDL_Rect all = {0, 0, w, h};
+        pending.push_back(all);
+    }
+
+    if(success) {
         width = w;
         height = h;
+        current = 0;
+    } else {
+        free();
     }
-    return texture != nullptr;
+
+    return success;
 }
 
-void Texture::copyPixels(void *pix) {
-    if(pixels != nullptr) {
-        memcpy(pixels, pix, pitch*height);
+void StreamingTexture::free() {
+    for(unsigned int i = 0; i < textures.size(); i++) {
+        destroyTexture(textures[i]);
+    }
+    textures.clear();
+    pending.clear();
+    width = 0;
+    height = 0;
+}
+
+void StreamingTexture::update(void *pix, int srcPitch, const SDL_Rect *dirty) {
+    if(textures.empty()) {
+        return;
+    }
+
+    //Todas las texturas acumulan la region cambiada:
+    SDL_Rect all = {0, 0, width, height};
+    SDL_Rect changed = all;
+    if(dirty != nullptr && SDL_IntersectRect(dirty, &all, &changed) == SDL_FALSE) {
+        changed.w = 0;
+        changed.h = 0;
+    }
+    for(unsigned int i = 0; i < pending.size(); i++) {
+        SDL_UnionRect(&pending[i], &changed, &pending[i]);
+    }
+
+    //Pasamos a la siguiente textura para no tocar la que puede estar usando la GPU:
+    current = (current + 1) % textures.size();
+    SDL_Rect &region = pending[current];
+    if(region.w > 0 && region.h > 0) {
+        //SDL_UpdateTexture respeta el pitch del origen fila a fila:
+        Uint8 *source = (Uint8*)pix + region.y * srcPitch + region.x * 4;
+        SDL_UpdateTexture(textures[current], &region, source, srcPitch);
+    }
+    region.w = 0;
+    region.h = 0;
+}
+
+void StreamingTexture::render(int x, int y) {
+    if(!textures.empty()) {
+        SDL_Rect rect = {x, y, width, height};
+        SDL_RenderCopy(renderer, textures[current], nullptr, &rect);
+    }
+}
+
+int StreamingTexture::getWidth() {
+    return width;
+}
+
+int StreamingTexture::getHeight() {
+    return height;
+}
+
+StreamingTexture streamingTexture;
+
+//Cola lock-free de un productor y un consumidor. Los elementos se mueven, no se copian:
+template<typename T>
+class SPSCQueue {
+    public:
+        //La capacidad tiene que ser potencia de dos:
+        SPSCQueue(unsigned int capacity);
+
+        //Solo desde el productor; si esta llena devuelve false y no toca el elemento:
+        bool push(T &&item);
+        //Solo desde el consumidor:
+        bool pop(T &item);
+        //Primer elemento sin sacarlo, nullptr si esta vacia (solo consumidor):
+        T *front();
+    private:
+        std::vector<T> items;
+        Uint32 mask;
+        //Cada indice en su linea de cache para que los hilos no se pisen:
+        alignas(64) std::atomic<Uint32> head{0};
+        alignas(64) std::atomic<Uint32> tail{0};
+};
+
+template<typename T>
+SPSCQueue<T>::SPSCQueue(unsigned int capacity) : items(capacity) {
+    //Con otra capacidad los contadores al dar la vuelta se saltarian celdas:
+    SDL_assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    mask = capacity - 1;
+}
+
+template<typename T>
+bool SPSCQueue<T>::push(T &&item) {
+    Uint32 currentHead = head.load(std::memory_order_relaxed);
+    if(currentHead - tail.load(std::memory_order_acquire) >= items.size()) {
+        return false;
     }
+    items[currentHead & mask] = std::move(item);
+    head.store(currentHead + 1, std::memory_order_release);
+    return true;
 }
 
-Texture streamingTexture;
+template<typename T>
+bool SPSCQueue<T>::pop(T &item) {
+    Uint32 currentTail = tail.load(std::memory_order_relaxed);
+    if(head.load(std::memory_order_acquire) == currentTail) {
+        return false;
+    }
+    item = std::move(items[currentTail & mask]);
+    tail.store(currentTail + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+T *SPSCQueue<T>::front() {
+    Uint32 currentTail = tail.load(std::memory_order_relaxed);
+    if(head.load(std::memory_order_acquire) == currentTail) {
+        return nullptr;
+    }
+    return &items[currentTail & mask];
+}
+
+//La misma cola con mutex y variable de condicion, solo para comparar en el benchmark:
+template<typename T>
+class LockedQueue {
+    public:
+        //La capacidad tiene que ser potencia de dos, igual que en SPSCQueue:
+        LockedQueue(unsigned int capacity);
+
+        bool push(T &&item);
+        //Espera hasta que haya un elemento:
+        void waitPop(T &item);
+    private:
+        std::vector<T> items;
+        Uint32 mask;
+        Uint32 head{0};
+        Uint32 tail{0};
+        std::mutex mutex;
+        std::condition_variable notEmpty;
+};
+
+template<typename T>
+LockedQueue<T>::LockedQueue(unsigned int capacity) : items(capacity) {
+    SDL_assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    mask = capacity - 1;
+}
+
+template<typename T>
+bool LockedQueue<T>::push(T &&item) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(head - tail >= items.size()) {
+            return false;
+        }
+        items[head & mask] = std::move(item);
+        head++;
+    }
+    notEmpty.notify_one();
+    return true;
+}
+
+template<typename T>
+void LockedQueue<T>::waitPop(T &item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notEmpty.wait(lock, [this] { return head != tail; });
+    item = std::move(items[tail & mask]);
+    tail++;
+}
+
+//Un frame en memoria; al moverlo solo se pasa la propiedad del buffer:
+struct PixelBuffer {
+    Uint32 frame{0};
+    SDL_Rect dirty{0, 0, 0, 0};
+    std::vector<Uint8> pixels;
+    //Momento en el que se publico, para medir la latencia:
+    Uint64 timestamp{0};
+};
+
+//Cabecera de los clips en crudo ("RAW1"), seguida de los frames RGBA8888 uno detras de otro:
+const Uint32 CLIP_MAGIC = 0x31574152;
+const int CLIP_HEADER_SIZE = 5 * sizeof(Sint32);
+
+//Frames que se mantienen en memoria como maximo, sea cual sea la duracion del clip:
+const int STREAM_SLOTS = 4;
 
 //Animation stream:
 class DataStream {
     public:
-        //Carga los datos inciales:
+        //Abre el clip (creandolo desde los png si no existe) y lanza el hilo de lectura:
         bool loadMedia();
         //Liberar recursos:
         void free();
+        //Busca el frame que toca en este instante, devuelve true si la imagen ha cambiado:
+        bool update(Uint32 time);
         //Getter del buffer:
         void* getBuffer();
+        int getPitch();
+        //Region que ha cambiado en el ultimo update:
+        SDL_Rect *getDirtyRect();
+
+        int getWidth();
+        int getHeight();
     private:
-        SDL_Surface *images[4];
-        int currentImage{0};
-        int delayFrames{4};
+        //Convierte las imagenes de la animacion en un clip en crudo:
+        bool buildClip(std::string path);
+
+        //Hilo productor: lee frames secuencialmente del disco:
+        static int producerThread(void *data);
+        void produce();
+
+        SDL_RWops *file{nullptr};
+        SDL_Thread *thread{nullptr};
+        std::atomic<bool> running{false};
+
+        int width{0};
+        int height{0};
+        int pitch{0};
+        int frameCount{0};
+        int fps{0};
+
+        //Frames listos para el render y buffers ya usados que vuelven al productor:
+        SPSCQueue<PixelBuffer> readyFrames{STREAM_SLOTS};
+        SPSCQueue<PixelBuffer> freeFrames{STREAM_SLOTS};
+        //Frame que esta mostrando el render, es suyo hasta que lo devuelve:
+        PixelBuffer current;
+        //Frame que quiere el consumidor, el productor se salta los anteriores:
+        std::atomic<Uint32> targetFrame{0};
+
+        //Region cambiada en el ultimo update:
+        SDL_Rect dirty{0, 0, 0, 0};
+        bool started{false};
 };
 
-bool DataStream::loadMedia() {
+//Rectangulo que engloba los pixeles distintos entre dos frames del mismo tamano:
+SDL_Rect diffRect(Uint8 *a, Uint8 *b, int w, int h, int pitch) {
+    int minX = w;
+    int minY = h;
+    int maxX = -1;
+    int maxY = -1;
+    for(int y = 0; y < h; y++) {
+        Uint32 *rowA = (Uint32*)(a + y * pitch);
+        Uint32 *rowB = (Uint32*)(b + y * pitch);
+        //Las filas iguales se descartan con un solo memcmp:
+        if(memcmp(rowA, rowB, w * 4) == 0) {
+            continue;
+        }
+        for(int x = 0; x < w; x++) {
+            if(rowA[x] != rowB[x]) {
+                if(x < minX) {
+                    minX = x;
+                }
+                if(x > maxX) {
+                    maxX = x;
+                }
+                if(y < minY) {
+                    minY = y;
+                }
+                maxY = y;
+            }
+        }
+    }
+
+    SDL_Rect rect = {0, 0, 0, 0};
+    if(maxX >= 0) {
+        rect.x = minX;
+        rect.y = minY;
+        rect.w = maxX - minX + 1;
+        rect.h = maxY - minY + 1;
+    }
+    return rect;
+}
+
+bool DataStream::buildClip(std::string path) {
     bool success = true;
 
+    SDL_Surface *images[4] = {nullptr, nullptr, nullptr, nullptr};
     for(int i = 0; i < 4; i++) {
         std::stringstream ss;
         ss << "assets/lesson42/foo_walk_" << i << ".png";
-        SDL_Surface *surf = IMG_Load(ss.str().c_str());
+        SDL_Surface *surf = loadSurface(ss.str(), RESOURCE_SITE);
         if(surf == nullptr) {
             cout << "No se ha podido cargar la imagen: " << IMG_GetError() << endl;
             success = false;
         } else {
-            images[i] = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_RGBA8888, 0);
+            images[i] = convertSurface(surf, SDL_PIXELFORMAT_RGBA8888, RESOURCE_SITE);
+            if(images[i] == nullptr) {
+                cout << "No se ha podido convertir la imagen: " << SDL_GetError() << endl;
+                success = false;
+            } else if(images[0] != nullptr && (images[i]->w != images[0]->w || images[i]->h != images[0]->h)) {
+                //El clip guarda un solo tamano para todos los frames:
+                cout << "Los frames del clip no tienen el mismo tamano: " << ss.str() << endl;
+                success = false;
+            }
+        }
+
+        freeSurface(surf);
+    }
+
+    if(success) {
+        SDL_RWops *out = SDL_RWFromFile(path.c_str(), "w+b");
+        if(out == nullptr) {
+            cout << "No se ha podido crear el clip: " << SDL_GetError() << endl;
+            success = false;
+        } else {
+            //Cada imagen se mostraba 4 frames a 60 fps, asi que el clip va a 15 fps:
+            Sint32 header[5] = {(Sint32)CLIP_MAGIC, images[0]->w, images[0]->h, 4, 15};
+            SDL_RWwrite(out, header, sizeof(Sint32), 5);
+            for(int i = 0; i < 4; i++) {
+                //Guardamos sin el relleno del pitch de la superficie:
+                for(int row = 0; row < images[0]->h; row++) {
+                    SDL_RWwrite(out, (Uint8*)images[i]->pixels + row * images[i]->pitch, images[0]->w * 4, 1);
+                }
+            }
+            SDL_RWclose(out);
+        }
+    }
+
+    for(int i = 0; i < 4; i++) {
+        freeSurface(images[i]);
+    }
+
+    return success;
+}
+
+bool DataStream::loadMedia() {
+    bool success = true;
+    std::string path = "assets/lesson42/foo_walk.raw";
+
+    file = SDL_RWFromFile(path.c_str(), "rb");
+    if(file == nullptr && buildClip(path)) {
+        file = SDL_RWFromFile(path.c_str(), "rb");
+    }
+
+    Sint32 header[5] = {0, 0, 0, 0, 0};
+    if(file == nullptr) {
+        cout << "No se ha podido abrir el clip: " << SDL_GetError() << endl;
+        success = false;
+    } else if(SDL_RWread(file, header, sizeof(Sint32), 5) != 5 || (Uint32)header[0] != CLIP_MAGIC || header[3] <= 0 || header[4] <= 0) {
+        cout << "El clip no es valido" << endl;
+        success = false;
+    } else {
+        width = header[1];
+        height = header[2];
+        pitch = width * 4;
+        frameCount = header[3];
+        fps = header[4];
+
+        //Todos los buffers se reservan aqui y luego solo cambian de dueno:
+        for(int i = 0; i < STREAM_SLOTS; i++) {
+            PixelBuffer buffer;
+            buffer.pixels.resize(pitch * height);
+            freeFrames.push(std::move(buffer));
         }
 
-        SDL_FreeSurface(surf);
+        running = true;
+        thread = SDL_CreateThread(producerThread, "DataStream", this);
+        if(thread == nullptr) {
+            cout << "No se ha podido crear el hilo: " << SDL_GetError() << endl;
+            running = false;
+            success = false;
+        } else {
+            //Esperamos al primer frame para tener algo que mostrar:
+            while(running && !readyFrames.pop(current)) {
+                SDL_Delay(1);
+            }
+            success = !current.pixels.empty();
+        }
     }
 
     return success;
 }
 
 void DataStream::free() {
-    for(int i = 0; i < 4; i++) {
-        SDL_FreeSurface(images[i]);
+    if(thread != nullptr) {
+        running = false;
+        SDL_WaitThread(thread, nullptr);
+        thread = nullptr;
+    }
+    if(file != nullptr) {
+        SDL_RWclose(file);
+        file = nullptr;
+    }
+    PixelBuffer buffer;
+    while(readyFrames.pop(buffer) || freeFrames.pop(buffer)) {
     }
+    current = PixelBuffer();
 }
 
-void *DataStream::getBuffer() {
-    delayFrames--;
-    if(delayFrames == 0) {
-        currentImage++;
-        delayFrames = 4;
+int DataStream::producerThread(void *data) {
+    static_cast<DataStream*>(data)->produce();
+    return 0;
+}
+
+void DataStream::produce() {
+    Uint32 frame = 0;
+    int frameBytes = pitch * height;
+    bool first = true;
+    //Copia propia del frame anterior, el que se entrega ya no es nuestro:
+    std::vector<Uint8> previous(frameBytes);
+    Uint32 previousFrame = 0;
+
+    while(running) {
+        PixelBuffer buffer;
+        if(!freeFrames.pop(buffer)) {
+            //Sin buffers libres, el render va por detras:
+            SDL_Delay(1);
+            continue;
+        }
+
+        //Si el render va por delante nos saltamos los frames que ya no se van a ver:
+        Uint32 target = targetFrame.load(std::memory_order_relaxed);
+        if(frame < target) {
+            frame = target;
+        }
+        SDL_RWseek(file, CLIP_HEADER_SIZE + (Sint64)(frame % frameCount) * frameBytes, RW_SEEK_SET);
+
+        if(SDL_RWread(file, &buffer.pixels[0], frameBytes, 1) != 1) {
+            cout << "Error leyendo el clip: " << SDL_GetError() << endl;
+            running = false;
+            break;
+        }
+        buffer.frame = frame;
+
+        //La diferencia se calcula aqui, fuera del hilo de render:
+        SDL_Rect all = {0, 0, width, height};
+        if(first || previousFrame + 1 != frame) {
+            buffer.dirty = all;
+        } else {
+            buffer.dirty = diffRect(&buffer.pixels[0], &previous[0], width, height, pitch);
+        }
+        memcpy(&previous[0], &buffer.pixels[0], frameBytes);
+        previousFrame = frame;
+        first = false;
+
+        //Entregamos el buffer, hay tantos huecos como buffers asi que nunca falla:
+        readyFrames.push(std::move(buffer));
+        frame++;
     }
+}
+
+bool DataStream::update(Uint32 time) {
+    Uint32 target = (Uint32)((Uint64)time * fps / 1000);
+    targetFrame.store(target, std::memory_order_relaxed);
 
-    if(currentImage == 4) {
-        currentImage = 0;
+    //El rectangulo anterior ya se ha subido:
+    dirty.w = 0;
+    dirty.h = 0;
+
+    bool changed = false;
+    if(!started) {
+        dirty = current.dirty;
+        started = true;
+        changed = true;
     }
 
-    return images[currentImage]->pixels;
+    //Avanzamos mientras el siguiente frame ya deba verse, descartando los intermedios:
+    PixelBuffer *next = readyFrames.front();
+    while(next != nullptr && next->frame <= target) {
+        //Devolvemos el frame anterior al productor y nos quedamos con el nuevo:
+        PixelBuffer old = std::move(current);
+        readyFrames.pop(current);
+        freeFrames.push(std::move(old));
+
+        SDL_UnionRect(&dirty, &current.dirty, &dirty);
+        changed = true;
+        next = readyFrames.front();
+    }
+
+    //Si no hay frame nuevo se repite el actual:
+    return changed;
+}
+
+void *DataStream::getBuffer() {
+    return &current.pixels[0];
+}
+
+int DataStream::getPitch() {
+    return pitch;
+}
+
+SDL_Rect *DataStream::getDirtyRect() {
+    return &dirty;
+}
+
+int DataStream::getWidth() {
+    return width;
+}
+
+int DataStream::getHeight() {
+    return height;
 }
 
 DataStream dataStream;
@@ -246,6 +959,11 @@ DataStream dataStream;
 bool init() {
     bool success = true;
 
+    //En modo headless no hay pantalla, usamos el driver dummy:
+    if(headless) {
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    }
+
     if(SDL_Init(SDL_INIT_VIDEO) < 0) {
         cout << SDL_GetError() << endl;
         success = false;
@@ -255,7 +973,7 @@ bool init() {
             cout << SDL_GetError() << endl;
             success = false;
         } else {
-            renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+            renderer = SDL_CreateRenderer(window, -1, headless ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
             if(renderer == nullptr) {
                 cout << SDL_GetError() << endl;
                 success = false;
@@ -274,12 +992,11 @@ bool init() {
 
 bool loadMedia() {
     bool success = true;
-    if(!streamingTexture.createBlank(64, 205)) {
-        success = false;
-    }
 
     if(!dataStream.loadMedia()) {
         success = false;
+    } else if(!streamingTexture.create(dataStream.getWidth(), dataStream.getHeight())) {
+        success = false;
     }
 
     return success;
@@ -292,15 +1009,111 @@ void close() {
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
 
+    //Todo lo creado con los helpers deberia estar liberado ya:
+    if(resources.reportLeaks() > 0) {
+        cout << "Memoria sin liberar: " << resources.getResidentBytes() << " bytes" << endl;
+    }
+
     IMG_Quit();
     SDL_Quit();
 }
 
+//Microbenchmark: latencia y throughput de pasar buffers de un hilo a otro.
+const int BENCH_HANDOFFS = 1000000;
+const int BENCH_LATENCY_SAMPLES = 100000;
+const int BENCH_CAPACITY = 64;
+
+void printBenchmark(std::string name, Uint64 elapsed, Uint64 totalLatency) {
+    double seconds = (double)elapsed / SDL_GetPerformanceFrequency();
+    double latency = (double)totalLatency / BENCH_LATENCY_SAMPLES / SDL_GetPerformanceFrequency() * 1000000.0;
+    cout << name << ": " << (Uint64)(BENCH_HANDOFFS / seconds) << " buffers/s, latencia media " << latency << " us" << endl;
+}
+
+template<typename Queue, typename Pop>
+void runBenchmark(std::string name, Queue &queue, Pop pop) {
+    //Throughput: el productor empuja todo lo que puede y la cola va llena:
+    Uint64 start = SDL_GetPerformanceCounter();
+    std::thread producer([&queue] {
+        for(int i = 0; i < BENCH_HANDOFFS; i++) {
+            PixelBuffer buffer;
+            buffer.frame = i;
+            while(!queue.push(std::move(buffer))) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    PixelBuffer buffer;
+    for(int i = 0; i < BENCH_HANDOFFS; i++) {
+        pop(queue, buffer);
+    }
+    producer.join();
+    Uint64 elapsed = SDL_GetPerformanceCounter() - start;
+
+    //Latencia: cada buffer sale cuando el anterior ya se ha recogido, con la cola
+    //vacia, asi no se cuenta el tiempo que pasaria esperando detras de otros:
+    std::atomic<int> received{0};
+    std::thread sender([&queue, &received] {
+        for(int i = 0; i < BENCH_LATENCY_SAMPLES; i++) {
+            while(received.load(std::memory_order_acquire) < i) {
+                std::this_thread::yield();
+            }
+            PixelBuffer buffer;
+            buffer.frame = i;
+            buffer.timestamp = SDL_GetPerformanceCounter();
+            while(!queue.push(std::move(buffer))) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    Uint64 totalLatency = 0;
+    for(int i = 0; i < BENCH_LATENCY_SAMPLES; i++) {
+        pop(queue, buffer);
+        totalLatency += SDL_GetPerformanceCounter() - buffer.timestamp;
+        received.store(i + 1, std::memory_order_release);
+    }
+    sender.join();
+
+    printBenchmark(name, elapsed, totalLatency);
+}
+
+void benchmarkQueues() {
+    SPSCQueue<PixelBuffer> lockFree(BENCH_CAPACITY);
+    runBenchmark("SPSC lock-free", lockFree, [](SPSCQueue<PixelBuffer> &queue, PixelBuffer &buffer) {
+        while(!queue.pop(buffer)) {
+            std::this_thread::yield();
+        }
+    });
+
+    LockedQueue<PixelBuffer> locked(BENCH_CAPACITY);
+    runBenchmark("Mutex + condition variable", locked, [](LockedQueue<PixelBuffer> &queue, PixelBuffer &buffer) {
+        queue.waitPop(buffer);
+    });
+}
+
+//benchmark.cpp incluye este archivo para medir la textura de streaming, sin su main:
+#ifndef LESSON_NO_MAIN
 int main(int argc, char* argv[]) {
+    parseArgs(argc, argv);
+
+    if(benchQueue) {
+        benchmarkQueues();
+        return 0;
+    }
+
     if(init()) {
         if(loadMedia()) {
             bool quit = false;
             SDL_Event e;
+
+            //El clip se reproduce segun el tiempo real, no segun los frames renderizados:
+            Uint32 startTime = SDL_GetTicks();
+            //Contador de frames y tiempo para el modo headless:
+            int frame = 0;
+            Uint64 startCounter = SDL_GetPerformanceCounter();
+            //Memoria residente en el titulo, para ver que no crece con el tiempo:
+            std::string lastTitle;
             while(!quit) {
                 while(SDL_PollEvent(&e)) {
                     if(e.type == SDL_QUIT) {
@@ -311,19 +1124,32 @@ int main(int argc, char* argv[]) {
                 SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
                 SDL_RenderClear(renderer);
 
-                //Copiamos la imagen del buffer:
-                streamingTexture.lockTexture();
-                streamingTexture.copyPixels(dataStream.getBuffer());
-                streamingTexture.unlockTexture();
+                //Solo subimos la imagen si ha cambiado, y solo la parte que cambia:
+                if(dataStream.update(SDL_GetTicks() - startTime)) {
+                    streamingTexture.update(dataStream.getBuffer(), dataStream.getPitch(), dataStream.getDirtyRect());
+                }
 
                 //Renderizamos:
                 streamingTexture.render((SCREEN_WIDTH - streamingTexture.getWidth())/2, (SCREEN_HEIGHT - streamingTexture.getHeight())/2);
 
                 //Presentamos:
                 SDL_RenderPresent(renderer);
+
+                std::string title = "Streaming textures - " + describeResources();
+                if(title != lastTitle) {
+                    SDL_SetWindowTitle(window, title.c_str());
+                    lastTitle = title;
+                }
+
+                frame++;
+                if(headless && frame >= headlessFrames) {
+                    reportFrames(frame, SDL_GetPerformanceCounter() - startCounter);
+                    quit = true;
+                }
             }
         }
     }
     close();
     return 0;
 }
+#endif
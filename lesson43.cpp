@@ -1,8 +1,12 @@
 #include <SDL.h>
 #include <SDL_image.h>
 #include <string>
+#include <cstdlib>
 #include <cstring>
 #include <sstream>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
 #include <iostream>
 using namespace std;
 
@@ -12,10 +16,358 @@ const int SCREEN_HEIGHT = 480;
 SDL_Renderer *renderer;
 SDL_Window *window;
 
+//Modo headless para medir rendimiento sin pantalla: driver de video dummy,
+//renderer software sin vsync y un numero fijo de frames:
+bool headless = false;
+int headlessFrames = 0;
+
+//Lee --headless <frames> de la linea de comandos:
+void parseArgs(int argc, char* argv[]) {
+    for(int i = 1; i < argc; i++) {
+        if(std::string(argv[i]) == "--headless" && i + 1 < argc) {
+            headless = true;
+            headlessFrames = atoi(argv[++i]);
+        }
+    }
+}
+
+//Imprime los frames por segundo al acabar:
+void reportFrames(int frames, Uint64 elapsed) {
+    double seconds = (double)elapsed / SDL_GetPerformanceFrequency();
+    cout << "frames: " << frames << ", segundos: " << seconds << ", fps: " << (seconds > 0 ? frames / seconds : 0) << endl;
+}
+
+//Sitio de creacion de un recurso como "archivo:linea":
+#define RESOURCE_SITE_LINE(line) #line
+#define RESOURCE_SITE_STRING(line) RESOURCE_SITE_LINE(line)
+#define RESOURCE_SITE __FILE__ ":" RESOURCE_SITE_STRING(__LINE__)
+
+//Lleva la cuenta de las texturas y superficies vivas creadas con los helpers
+//de abajo: tamano, formato, bytes y donde se crearon. Sirve para ver la
+//memoria residente en cada momento y las fugas al cerrar:
+class ResourceTracker {
+    public:
+        ResourceTracker();
+
+        void trackTexture(SDL_Texture *texture, const char *site);
+        void untrackTexture(SDL_Texture *texture);
+        void trackSurface(SDL_Surface *surface, const char *site);
+        void untrackSurface(SDL_Surface *surface);
+
+        size_t getResidentBytes();
+        size_t getPeakBytes();
+        size_t getTextureCount();
+        size_t getSurfaceCount();
+
+        //Imprime lo que sigue vivo y devuelve cuantos recursos son:
+        size_t reportLeaks();
+
+    private:
+        struct Resource {
+            int width;
+            int height;
+            Uint32 format;
+            size_t bytes;
+            const char *site;
+        };
+
+        void add(std::unordered_map<const void*, Resource> &resources, const void *handle, Resource resource);
+        void remove(std::unordered_map<const void*, Resource> &resources, const void *handle);
+
+        std::unordered_map<const void*, Resource> textures;
+        std::unordered_map<const void*, Resource> surfaces;
+        size_t residentBytes;
+        size_t peakBytes;
+};
+
+ResourceTracker::ResourceTracker() {
+    residentBytes = 0;
+    peakBytes = 0;
+}
+
+void ResourceTracker::trackTexture(SDL_Texture *texture, const char *site) {
+    if(texture == nullptr) {
+        return;
+    }
+
+    Resource resource = {0, 0, 0, 0, site};
+    SDL_QueryTexture(texture, &resource.format, nullptr, &resource.width, &resource.height);
+    resource.bytes = (size_t)resource.width * resource.height * SDL_BYTESPERPIXEL(resource.format);
+    add(textures, texture, resource);
+}
+
+void ResourceTracker::untrackTexture(SDL_Texture *texture) {
+    remove(textures, texture);
+}
+
+void ResourceTracker::trackSurface(SDL_Surface *surface, const char *site) {
+    if(surface == nullptr) {
+        return;
+    }
+
+    Resource resource = {surface->w, surface->h, surface->format->format, (size_t)surface->pitch * surface->h, site};
+    add(surfaces, surface, resource);
+}
+
+void ResourceTracker::untrackSurface(SDL_Surface *surface) {
+    remove(surfaces, surface);
+}
+
+void ResourceTracker::add(std::unordered_map<const void*, Resource> &resources, const void *handle, Resource resource) {
+    resources[handle] = resource;
+    residentBytes += resource.bytes;
+    peakBytes = max(peakBytes, residentBytes);
+}
+
+void ResourceTracker::remove(std::unordered_map<const void*, Resource> &resources, const void *handle) {
+    std::unordered_map<const void*, Resource>::iterator found = resources.find(handle);
+    if(found != resources.end()) {
+        residentBytes -= found->second.bytes;
+        resources.erase(found);
+    }
+}
+
+size_t ResourceTracker::getResidentBytes() {
+    return residentBytes;
+}
+
+size_t ResourceTracker::getPeakBytes() {
+    return peakBytes;
+}
+
+size_t ResourceTracker::getTextureCount() {
+    return textures.size();
+}
+
+size_t ResourceTracker::getSurfaceCount() {
+    return surfaces.size();
+}
+
+size_t ResourceTracker::reportLeaks() {
+    for(std::unordered_map<const void*, Resource>::iterator i = textures.begin(); i != textures.end(); ++i) {
+        cout << "Textura sin liberar de " << i->second.width << "x" << i->second.height << " " << SDL_GetPixelFormatName(i->second.format) << " (" << i->second.bytes << " bytes) creada en " << i->second.site << endl;
+    }
+    for(std::unordered_map<const void*, Resource>::iterator i = surfaces.begin(); i != surfaces.end(); ++i) {
+        cout << "Superficie sin liberar de " << i->second.width << "x" << i->second.height << " " << SDL_GetPixelFormatName(i->second.format) << " (" << i->second.bytes << " bytes) creada en " << i->second.site << endl;
+    }
+    return textures.size() + surfaces.size();
+}
+
+ResourceTracker resources;
+
+//Helpers para crear y destruir recursos pasando por el tracker:
+SDL_Texture *createTexture(Uint32 format, int access, int w, int h, const char *site) {
+    SDL_Texture *texture = SDL_CreateTexture(renderer, format, access, w, h);
+    resources.trackTexture(texture, site);
+    return texture;
+}
+
+void destroyTexture(SDL_Texture *texture) {
+    if(texture != nullptr) {
+        resources.untrackTexture(texture);
+        SDL_DestroyTexture(texture);
+    }
+}
+
+SDL_Surface *loadSurface(std::string path, const char *site) {
+    SDL_Surface *surface = IMG_Load(path.c_str());
+    resources.trackSurface(surface, site);
+    return surface;
+}
+
+SDL_Surface *convertSurface(SDL_Surface *surface, Uint32 format, const char *site) {
+    SDL_Surface *converted = SDL_ConvertSurfaceFormat(surface, format, 0);
+    resources.trackSurface(converted, site);
+    return converted;
+}
+
+void freeSurface(SDL_Surface *surface) {
+    if(surface != nullptr) {
+        resources.untrackSurface(surface);
+        SDL_FreeSurface(surface);
+    }
+}
+
+//Memoria residente para el titulo de la ventana:
+string describeResources() {
+    return to_string(resources.getTextureCount()) + " texturas, " + to_string(resources.getSurfaceCount()) + " superficies, " +
+           to_string(resources.getResidentBytes() / 1024) + " KB residentes (pico " + to_string(resources.getPeakBytes() / 1024) + " KB)";
+}
+
+//Contadores de lo que se manda al renderer en un frame:
+struct RenderStats {
+    int copyCalls;
+    int primitiveCalls;
+    int clearCalls;
+    int colorCalls;
+    int targetCalls;
+    //Copias con una textura distinta de la anterior y cambios reales de target:
+    int textureSwitches;
+    int targetSwitches;
+    //Pixeles aproximados que tocan las copias y primitivas, y bytes subidos:
+    Sint64 pixelsCovered;
+    Sint64 bytesUploaded;
+};
+
+//Todas las llamadas de dibujo pasan por aqui para poder contarlas. Los
+//contadores del frame en curso se guardan en endFrame():
+class RenderDevice {
+    public:
+        RenderDevice();
+
+        void setDrawColor(Uint8 r, Uint8 g, Uint8 b, Uint8 a);
+        void setTarget(SDL_Texture *target);
+        SDL_Texture *getTarget();
+        void clear();
+        void copy(SDL_Texture *texture, const SDL_Rect *clip, const SDL_Rect *quad, double angle = 0.0, const SDL_Point *center = nullptr);
+        void fillRects(const SDL_Rect *rects, int count);
+        void drawRects(const SDL_Rect *rects, int count);
+        void drawLines(const SDL_Point *points, int count);
+        void drawPoints(const SDL_Point *points, int count);
+
+        //Bytes que se suben al desbloquear una textura streaming:
+        void countUpload(Sint64 bytes);
+
+        void endFrame();
+        //Contadores del ultimo frame terminado y del que esta en curso:
+        RenderStats getFrameStats();
+        RenderStats getCurrentStats();
+
+    private:
+        Sint64 getTargetArea();
+
+        RenderStats current;
+        RenderStats last;
+        SDL_Texture *lastTexture;
+        SDL_Texture *currentTarget;
+};
+
+RenderDevice::RenderDevice() {
+    memset(&current, 0, sizeof(current));
+    memset(&last, 0, sizeof(last));
+    lastTexture = nullptr;
+    currentTarget = nullptr;
+}
+
+void RenderDevice::setDrawColor(Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+    current.colorCalls++;
+    SDL_SetRenderDrawColor(renderer, r, g, b, a);
+}
+
+void RenderDevice::setTarget(SDL_Texture *target) {
+    current.targetCalls++;
+    if(target != currentTarget) {
+        current.targetSwitches++;
+        currentTarget = target;
+    }
+    SDL_SetRenderTarget(renderer, target);
+}
+
+SDL_Texture *RenderDevice::getTarget() {
+    return currentTarget;
+}
+
+void RenderDevice::clear() {
+    current.clearCalls++;
+    current.pixelsCovered += getTargetArea();
+    SDL_RenderClear(renderer);
+}
+
+void RenderDevice::copy(SDL_Texture *texture, const SDL_Rect *clip, const SDL_Rect *quad, double angle, const SDL_Point *center) {
+    current.copyCalls++;
+    if(texture != lastTexture) {
+        current.textureSwitches++;
+        lastTexture = texture;
+    }
+    current.pixelsCovered += quad != nullptr ? (Sint64)quad->w * quad->h : getTargetArea();
+
+    if(angle == 0.0) {
+        SDL_RenderCopy(renderer, texture, clip, quad);
+    } else {
+        SDL_RenderCopyEx(renderer, texture, clip, quad, angle, center, SDL_FLIP_NONE);
+    }
+}
+
+void RenderDevice::fillRects(const SDL_Rect *rects, int count) {
+    current.primitiveCalls++;
+    for(int i = 0; i < count; i++) {
+        current.pixelsCovered += (Sint64)rects[i].w * rects[i].h;
+    }
+    SDL_RenderFillRects(renderer, rects, count);
+}
+
+void RenderDevice::drawRects(const SDL_Rect *rects, int count) {
+    current.primitiveCalls++;
+    for(int i = 0; i < count; i++) {
+        current.pixelsCovered += 2 * (rects[i].w + rects[i].h);
+    }
+    SDL_RenderDrawRects(renderer, rects, count);
+}
+
+void RenderDevice::drawLines(const SDL_Point *points, int count) {
+    current.primitiveCalls++;
+    for(int i = 1; i < count; i++) {
+        current.pixelsCovered += max(abs(points[i].x - points[i - 1].x), abs(points[i].y - points[i - 1].y)) + 1;
+    }
+    SDL_RenderDrawLines(renderer, points, count);
+}
+
+void RenderDevice::drawPoints(const SDL_Point *points, int count) {
+    current.primitiveCalls++;
+    current.pixelsCovered += count;
+    SDL_RenderDrawPoints(renderer, points, count);
+}
+
+void RenderDevice::countUpload(Sint64 bytes) {
+    current.bytesUploaded += bytes;
+}
+
+void RenderDevice::endFrame() {
+    last = current;
+    memset(&current, 0, sizeof(current));
+    //El primer copy del frame siguiente cuenta como cambio de textura:
+    lastTexture = nullptr;
+}
+
+RenderStats RenderDevice::getFrameStats() {
+    return last;
+}
+
+RenderStats RenderDevice::getCurrentStats() {
+    return current;
+}
+
+Sint64 RenderDevice::getTargetArea() {
+    int w = 0;
+    int h = 0;
+    if(currentTarget != nullptr) {
+        SDL_QueryTexture(currentTarget, nullptr, nullptr, &w, &h);
+    } else {
+        SDL_GetRendererOutputSize(renderer, &w, &h);
+    }
+    return (Sint64)w * h;
+}
+
+RenderDevice renderDevice;
+
+string describeStats(const RenderStats &stats) {
+    return to_string(stats.copyCalls) + " copias, " + to_string(stats.primitiveCalls) + " primitivas, " +
+           to_string(stats.clearCalls) + " clears, " + to_string(stats.colorCalls) + " colores, " +
+           to_string(stats.textureSwitches) + " cambios de textura, " + to_string(stats.targetSwitches) + " cambios de target, " +
+           to_string(stats.pixelsCovered) + " pixeles, " + to_string(stats.bytesUploaded) + " bytes subidos";
+}
+
 class Texture {
     public:
+        Texture() = default;
         ~Texture();
 
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
+
         bool createBlank(int w, int h, SDL_TextureAccess access = SDL_TEXTUREACCESS_STREAMING);
         bool loadFromFile(string path);
         void free();
@@ -35,9 +387,9 @@ class Texture {
         int getPitch();
         Uint32 getPixel32(unsigned int x, unsigned int y);
     private:
-        SDL_Texture *texture;
-        void *pixels;
-        int pitch;
+        SDL_Texture *texture{nullptr};
+        void *pixels{nullptr};
+        int pitch{0};
 
         int width{0};
         int height{0};
@@ -47,18 +399,38 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(pixels, other.pixels);
+    swap(pitch, other.pitch);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(pixels, other.pixels);
+        swap(pitch, other.pitch);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 bool Texture::loadFromFile(string path) {
-    SDL_Surface *surf = IMG_Load(path.c_str());
+    SDL_Surface *surf = loadSurface(path, RESOURCE_SITE);
     if(surf == nullptr) {
         cout << SDL_GetError() << endl;
     } else {
         free();
-        SDL_Surface *formattedSurface = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_RGBA8888, 0);
-        texture = SDL_CreateTextureFromSurface(renderer, surf);
+        SDL_Surface *formattedSurface = convertSurface(surf, SDL_PIXELFORMAT_RGBA8888, RESOURCE_SITE);
         if(formattedSurface == nullptr) {
             cout << SDL_GetError() << endl;
         } else {
-            texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, formattedSurface->w, formattedSurface->h);
+            texture = createTexture(SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, formattedSurface->w, formattedSurface->h, RESOURCE_SITE);
             if(texture == nullptr) {
                 cout << SDL_GetError() << endl;
             } else {
@@ -85,14 +457,15 @@ bool Texture::loadFromFile(string path) {
                     }
                 }
 
-                //Desbloqueamos:
+                //Desbloqueamos, y es aqui cuando se suben los pixeles:
                 SDL_UnlockTexture(texture);
+                renderDevice.countUpload((Sint64)pitch * height);
                 pixels = nullptr;
             }
-            SDL_FreeSurface(formattedSurface);
+            freeSurface(formattedSurface);
         }
 
-        SDL_FreeSurface(surf);
+        freeSurface(surf);
     }
 
     return texture != nullptr;
@@ -100,7 +473,8 @@ bool Texture::loadFromFile(string path) {
 
 void Texture::free() {
     if(texture != nullptr) {
-        SDL_DestroyTexture(texture);
+        destroyTexture(texture);
+        texture = nullptr;
         width = 0;
         height = 0;
     }
@@ -112,7 +486,7 @@ void Texture::render(int x, int y, SDL_Rect *clip, double angle, SDL_Point *cent
         rect.w = clip->w;
         rect.h = clip->h;
     }
-    SDL_RenderCopyEx(renderer, texture, clip, &rect, angle, center, SDL_FLIP_NONE);
+    renderDevice.copy(texture, clip, &rect, angle, center);
 }
 
 bool Texture::lockTexture() {
@@ -138,7 +512,9 @@ bool Texture::unlockTexture() {
         cout << "Ya esta desbloqueada" << endl;
         success = false;
     } else {
+        //Al desbloquear se sube toda la textura bloqueada:
         SDL_UnlockTexture(texture);
+        renderDevice.countUpload((Sint64)pitch * height);
         pixels = nullptr;
         pitch = 0;
     }
@@ -171,7 +547,7 @@ int Texture::getPitch() {
 }
 
 bool Texture::createBlank(int w, int h, SDL_TextureAccess access) {
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, access, w, h);
+    texture = createTexture(SDL_PIXELFORMAT_RGBA8888, access, w, h, RESOURCE_SITE);
     if(texture == nullptr) {
         cout << "No se ha podido crear la textura en blanco: " << SDL_GetError() << endl;
     } else {
@@ -188,24 +564,500 @@ void Texture::copyPixels(void *pix) {
 }
 
 void Texture::setAsRenderTarget() {
-    SDL_SetRenderTarget(renderer, texture);
+    renderDevice.setTarget(texture);
 }
 
-Texture targetTexture;
+//Agrupa puntos, lineas y rectangulos para mandarlos en pocas llamadas. Solo se
+//juntan dibujados seguidos del mismo color y tipo, asi todo sale en el orden en
+//que se pidio y lo que se dibuja despues queda encima:
+class PrimitiveBatch {
+    public:
+        void drawPoint(int x, int y, SDL_Color color);
+        void drawLine(int x1, int y1, int x2, int y2, SDL_Color color);
+        void drawRect(SDL_Rect rect, SDL_Color color);
+        void fillRect(SDL_Rect rect, SDL_Color color);
+
+        //Manda todo al renderer y vacia el lote:
+        void flush();
+    private:
+        enum RunType { RUN_FILL_RECTS, RUN_RECTS, RUN_LINES, RUN_POINTS };
+
+        //Tramo de dibujados seguidos del mismo color y tipo. start y count son
+        //indices en el vector de su tipo (en lineStarts para las lineas):
+        struct Run {
+            SDL_Color color;
+            RunType type;
+            int start;
+            int count;
+        };
+
+        static bool sameColor(SDL_Color a, SDL_Color b);
+        //Tramo del siguiente dibujado, se abre uno nuevo si cambia el color o el tipo:
+        Run &getRun(SDL_Color color, RunType type, int start);
+
+        //Se reutilizan entre flush para no reservar memoria cada frame:
+        std::vector<Run> runs;
+        std::vector<SDL_Point> points;
+        //Las lineas seguidas se juntan en polilineas, cada una empieza en un indice:
+        std::vector<SDL_Point> linePoints;
+        std::vector<int> lineStarts;
+        std::vector<SDL_Rect> rects;
+        std::vector<SDL_Rect> fillRects;
+};
+
+bool PrimitiveBatch::sameColor(SDL_Color a, SDL_Color b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+PrimitiveBatch::Run &PrimitiveBatch::getRun(SDL_Color color, RunType type, int start) {
+    if(!runs.empty() && runs.back().type == type && sameColor(runs.back().color, color)) {
+        return runs.back();
+    }
+
+    Run run = {color, type, start, 0};
+    runs.push_back(run);
+    return runs.back();
+}
+
+void PrimitiveBatch::drawPoint(int x, int y, SDL_Color color) {
+    SDL_Point point = {x, y};
+    getRun(color, RUN_POINTS, points.size()).count++;
+    points.push_back(point);
+}
+
+void PrimitiveBatch::drawLine(int x1, int y1, int x2, int y2, SDL_Color color) {
+    //Las horizontales y verticales son rectangulos de un pixel de ancho:
+    if(x1 == x2 || y1 == y2) {
+        SDL_Rect rect = {x1 < x2 ? x1 : x2, y1 < y2 ? y1 : y2, (x1 < x2 ? x2 - x1 : x1 - x2) + 1, (y1 < y2 ? y2 - y1 : y1 - y2) + 1};
+        fillRect(rect, color);
+        return;
+    }
+
+    //Si empieza donde acabo la anterior del mismo tramo seguimos la misma polilinea:
+    Run &run = getRun(color, RUN_LINES, lineStarts.size());
+    if(run.count == 0 || linePoints.back().x != x1 || linePoints.back().y != y1) {
+        lineStarts.push_back(linePoints.size());
+        SDL_Point start = {x1, y1};
+        linePoints.push_back(start);
+        run.count++;
+    }
+    SDL_Point end = {x2, y2};
+    linePoints.push_back(end);
+}
+
+void PrimitiveBatch::drawRect(SDL_Rect rect, SDL_Color color) {
+    getRun(color, RUN_RECTS, rects.size()).count++;
+    rects.push_back(rect);
+}
+
+void PrimitiveBatch::fillRect(SDL_Rect rect, SDL_Color color) {
+    getRun(color, RUN_FILL_RECTS, fillRects.size()).count++;
+    fillRects.push_back(rect);
+}
+
+void PrimitiveBatch::flush() {
+    for(unsigned int i = 0; i < runs.size(); i++) {
+        Run &run = runs[i];
+        if(i == 0 || !sameColor(run.color, runs[i - 1].color)) {
+            renderDevice.setDrawColor(run.color.r, run.color.g, run.color.b, run.color.a);
+        }
+
+        if(run.type == RUN_FILL_RECTS) {
+            renderDevice.fillRects(&fillRects[run.start], run.count);
+        } else if(run.type == RUN_RECTS) {
+            renderDevice.drawRects(&rects[run.start], run.count);
+        } else if(run.type == RUN_LINES) {
+            for(int line = run.start; line < run.start + run.count; line++) {
+                int start = lineStarts[line];
+                int end = line + 1 < (int)lineStarts.size() ? lineStarts[line + 1] : linePoints.size();
+                renderDevice.drawLines(&linePoints[start], end - start);
+            }
+        } else {
+            renderDevice.drawPoints(&points[run.start], run.count);
+        }
+    }
+
+    //Vaciamos sin liberar la memoria:
+    runs.clear();
+    points.clear();
+    linePoints.clear();
+    lineStarts.clear();
+    rects.clear();
+    fillRects.clear();
+}
+
+//Tiempo por defecto que un render target puede estar sin usarse antes de destruirlo:
+const Uint32 DEFAULT_TARGET_IDLE_TIME = 5000;
+
+//Pool de render targets por tamano y formato, reutilizados entre frames y redimensionados:
+class RenderTargetPool {
+    public:
+        RenderTargetPool() = default;
+        ~RenderTargetPool();
+
+        //Solo se puede mover: una copia destruiria dos veces los mismos targets.
+        RenderTargetPool(const RenderTargetPool &other) = delete;
+        RenderTargetPool &operator=(const RenderTargetPool &other) = delete;
+        RenderTargetPool(RenderTargetPool &&other);
+        RenderTargetPool &operator=(RenderTargetPool &&other);
+
+        //Target temporal, vuelve al pool automaticamente en endFrame:
+        SDL_Texture *acquire(int w, int h, Uint32 format = SDL_PIXELFORMAT_RGBA8888);
+        //Target que se queda hasta que se devuelva con release:
+        SDL_Texture *acquireRetained(int w, int h, Uint32 format = SDL_PIXELFORMAT_RGBA8888);
+        void release(SDL_Texture *texture);
+
+        //Recupera los temporales y destruye los que llevan demasiado sin usarse:
+        void endFrame(Uint32 now);
+        void setIdleTime(Uint32 ms);
+        void free();
+
+        //Texturas creadas y destruidas en el ultimo frame, y cuantas hay en total:
+        int getFrameAllocations();
+        int getFrameReleases();
+        int getPooledCount();
+    private:
+        struct PooledTarget {
+            SDL_Texture *texture;
+            int width;
+            int height;
+            Uint32 format;
+            bool inUse;
+            bool retained;
+            Uint32 lastUsed;
+        };
+
+        SDL_Texture *take(int w, int h, Uint32 format, bool retained);
+
+        std::vector<PooledTarget> targets;
+        Uint32 idleTime{DEFAULT_TARGET_IDLE_TIME};
+        Uint32 lastFrameTime{0};
+
+        int allocations{0};
+        int releases{0};
+        int frameAllocations{0};
+        int frameReleases{0};
+};
+
+RenderTargetPool::~RenderTargetPool() {
+    free();
+}
+
+RenderTargetPool::RenderTargetPool(RenderTargetPool &&other) : RenderTargetPool() {
+    swap(targets, other.targets);
+    swap(idleTime, other.idleTime);
+    swap(lastFrameTime, other.lastFrameTime);
+    swap(allocations, other.allocations);
+    swap(releases, other.releases);
+    swap(frameAllocations, other.frameAllocations);
+    swap(frameReleases, other.frameReleases);
+}
+
+RenderTargetPool &RenderTargetPool::operator=(RenderTargetPool &&other) {
+    if(this != &other) {
+        free();
+        swap(targets, other.targets);
+        swap(idleTime, other.idleTime);
+        swap(lastFrameTime, other.lastFrameTime);
+        swap(allocations, other.allocations);
+        swap(releases, other.releases);
+        swap(frameAllocations, other.frameAllocations);
+        swap(frameReleases, other.frameReleases);
+    }
+    return *this;
+}
+
+SDL_Texture *RenderTargetPool::acquire(int w, int h, Uint32 format) {
+    return take(w, h, format, false);
+}
+
+SDL_Texture *RenderTargetPool::acquireRetained(int w, int h, Uint32 format) {
+    return take(w, h, format, true);
+}
+
+SDL_Texture *RenderTargetPool::take(int w, int h, Uint32 format, bool retained) {
+    //Primero buscamos uno libre con la misma clave:
+    for(unsigned int i = 0; i < targets.size(); i++) {
+        PooledTarget &target = targets[i];
+        if(!target.inUse && target.width == w && target.height == h && target.format == format) {
+            target.inUse = true;
+            target.retained = retained;
+            return target.texture;
+        }
+    }
+
+    SDL_Texture *texture = createTexture(format, SDL_TEXTUREACCESS_TARGET, w, h, RESOURCE_SITE);
+    if(texture == nullptr) {
+        cout << "No se ha podido crear el render target: " << SDL_GetError() << endl;
+    } else {
+        PooledTarget target = {texture, w, h, format, true, retained, lastFrameTime};
+        targets.push_back(target);
+        allocations++;
+    }
+    return texture;
+}
+
+void RenderTargetPool::release(SDL_Texture *texture) {
+    for(unsigned int i = 0; i < targets.size(); i++) {
+        if(targets[i].texture == texture) {
+            targets[i].inUse = false;
+            targets[i].retained = false;
+            targets[i].lastUsed = lastFrameTime;
+            break;
+        }
+    }
+}
+
+void RenderTargetPool::endFrame(Uint32 now) {
+    unsigned int kept = 0;
+    for(unsigned int i = 0; i < targets.size(); i++) {
+        PooledTarget &target = targets[i];
+        if(target.inUse) {
+            //Los temporales se dan por devueltos al acabar el frame:
+            if(!target.retained) {
+                target.inUse = false;
+            }
+            target.lastUsed = now;
+        } else if(now - target.lastUsed > idleTime) {
+            destroyTexture(target.texture);
+            releases++;
+            continue;
+        }
+        targets[kept++] = target;
+    }
+    targets.resize(kept);
+
+    frameAllocations = allocations;
+    frameReleases = releases;
+    allocations = 0;
+    releases = 0;
+    lastFrameTime = now;
+}
+
+void RenderTargetPool::setIdleTime(Uint32 ms) {
+    idleTime = ms;
+}
+
+void RenderTargetPool::free() {
+    for(unsigned int i = 0; i < targets.size(); i++) {
+        destroyTexture(targets[i].texture);
+    }
+    targets.clear();
+}
+
+int RenderTargetPool::getFrameAllocations() {
+    return frameAllocations;
+}
+
+int RenderTargetPool::getFrameReleases() {
+    return frameReleases;
+}
+
+int RenderTargetPool::getPooledCount() {
+    return targets.size();
+}
+
+RenderTargetPool targetPool;
+
+//Capa retenida: guarda sus comandos de dibujo y solo los rasteriza cuando cambian:
+class RenderLayer {
+    public:
+        RenderLayer() = default;
+        ~RenderLayer();
+
+        //Solo se puede mover: una copia devolveria dos veces el mismo target al pool.
+        RenderLayer(const RenderLayer &other) = delete;
+        RenderLayer &operator=(const RenderLayer &other) = delete;
+        RenderLayer(RenderLayer &&other);
+        RenderLayer &operator=(RenderLayer &&other);
+
+        //Pide su target al pool, si ya tenia uno lo devuelve:
+        bool create(int w, int h);
+        void free();
+
+        //Grabacion de comandos, cualquier cambio marca la capa como sucia:
+        void clear(SDL_Color color);
+        void fillRect(SDL_Rect rect, SDL_Color color);
+        void drawRect(SDL_Rect rect, SDL_Color color);
+        void drawLine(int x1, int y1, int x2, int y2, SDL_Color color);
+        void drawPoint(int x, int y, SDL_Color color);
+
+        //Fuerza a rasterizar de nuevo (por ejemplo si se pierden los render targets):
+        void markDirty();
+
+        //Compone la capa cacheada con su transformacion:
+        void render(int x, int y, double angle = 0, SDL_Point *center = NULL);
+    private:
+        enum CommandType {
+            COMMAND_FILL_RECT,
+            COMMAND_DRAW_RECT,
+            COMMAND_DRAW_LINE,
+            COMMAND_DRAW_POINT
+        };
+
+        struct DrawCommand {
+            CommandType type;
+            SDL_Color color;
+            //En las lineas son los dos extremos (x, y) y (w, h):
+            SDL_Rect rect;
+        };
+
+        void record(CommandType type, SDL_Rect rect, SDL_Color color);
+        //Vuelve a dibujar todos los comandos en la textura:
+        void rasterize();
+
+        SDL_Texture *target{nullptr};
+        int width{0};
+        int height{0};
+        PrimitiveBatch batch;
+        SDL_Color clearColor{0xFF, 0xFF, 0xFF, 0xFF};
+        std::vector<DrawCommand> commands;
+        bool dirty{true};
+};
+
+RenderLayer::~RenderLayer() {
+    free();
+}
+
+RenderLayer::RenderLayer(RenderLayer &&other) : RenderLayer() {
+    swap(target, other.target);
+    swap(width, other.width);
+    swap(height, other.height);
+    swap(batch, other.batch);
+    swap(clearColor, other.clearColor);
+    swap(commands, other.commands);
+    swap(dirty, other.dirty);
+}
+
+RenderLayer &RenderLayer::operator=(RenderLayer &&other) {
+    if(this != &other) {
+        free();
+        swap(target, other.target);
+        swap(width, other.width);
+        swap(height, other.height);
+        swap(batch, other.batch);
+        swap(clearColor, other.clearColor);
+        swap(commands, other.commands);
+        swap(dirty, other.dirty);
+    }
+    return *this;
+}
+
+bool RenderLayer::create(int w, int h) {
+    if(target != nullptr) {
+        targetPool.release(target);
+    }
+    target = targetPool.acquireRetained(w, h);
+    width = w;
+    height = h;
+    dirty = true;
+    return target != nullptr;
+}
+
+void RenderLayer::free() {
+    if(target != nullptr) {
+        targetPool.release(target);
+        target = nullptr;
+    }
+    commands.clear();
+}
+
+void RenderLayer::clear(SDL_Color color) {
+    clearColor = color;
+    commands.clear();
+    dirty = true;
+}
+
+void RenderLayer::fillRect(SDL_Rect rect, SDL_Color color) {
+    record(COMMAND_FILL_RECT, rect, color);
+}
+
+void RenderLayer::drawRect(SDL_Rect rect, SDL_Color color) {
+    record(COMMAND_DRAW_RECT, rect, color);
+}
+
+void RenderLayer::drawLine(int x1, int y1, int x2, int y2, SDL_Color color) {
+    SDL_Rect ends = {x1, y1, x2, y2};
+    record(COMMAND_DRAW_LINE, ends, color);
+}
+
+void RenderLayer::drawPoint(int x, int y, SDL_Color color) {
+    SDL_Rect point = {x, y, 1, 1};
+    record(COMMAND_DRAW_POINT, point, color);
+}
+
+void RenderLayer::markDirty() {
+    dirty = true;
+}
+
+void RenderLayer::record(CommandType type, SDL_Rect rect, SDL_Color color) {
+    DrawCommand command = {type, color, rect};
+    commands.push_back(command);
+    dirty = true;
+}
+
+void RenderLayer::rasterize() {
+    //Guardamos el target actual para dejarlo como estaba:
+    SDL_Texture *previousTarget = renderDevice.getTarget();
+    renderDevice.setTarget(target);
+
+    renderDevice.setDrawColor(clearColor.r, clearColor.g, clearColor.b, clearColor.a);
+    renderDevice.clear();
+
+    for(unsigned int i = 0; i < commands.size(); i++) {
+        DrawCommand &command = commands[i];
+        switch(command.type) {
+            case COMMAND_FILL_RECT:
+                batch.fillRect(command.rect, command.color);
+                break;
+            case COMMAND_DRAW_RECT:
+                batch.drawRect(command.rect, command.color);
+                break;
+            case COMMAND_DRAW_LINE:
+                batch.drawLine(command.rect.x, command.rect.y, command.rect.w, command.rect.h, command.color);
+                break;
+            case COMMAND_DRAW_POINT:
+                batch.drawPoint(command.rect.x, command.rect.y, command.color);
+                break;
+        }
+    }
+    batch.flush();
+
+    renderDevice.setTarget(previousTarget);
+    dirty = false;
+}
+
+void RenderLayer::render(int x, int y, double angle, SDL_Point *center) {
+    if(target == nullptr) {
+        return;
+    }
+    if(dirty) {
+        rasterize();
+    }
+    SDL_Rect rect = {x, y, width, height};
+    renderDevice.copy(target, nullptr, &rect, angle, center);
+}
+
+RenderLayer sceneLayer;
 
 bool init() {
     bool success = true;
 
+    //En modo headless no hay pantalla, usamos el driver dummy:
+    if(headless) {
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    }
+
     if(SDL_Init(SDL_INIT_VIDEO) < 0) {
         cout << SDL_GetError() << endl;
         success = false;
     } else {
-        window = SDL_CreateWindow("Streaming textures", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+        window = SDL_CreateWindow("Streaming textures", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
         if(window == nullptr) {
             cout << SDL_GetError() << endl;
             success = false;
         } else {
-            renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+            renderer = SDL_CreateRenderer(window, -1, headless ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
             if(renderer == nullptr) {
                 cout << SDL_GetError() << endl;
                 success = false;
@@ -225,24 +1077,56 @@ bool init() {
 bool loadMedia() {
     bool success = true;
 
-    if(!targetTexture.createBlank(SCREEN_WIDTH, SCREEN_HEIGHT, SDL_TEXTUREACCESS_TARGET)) {
+    if(!sceneLayer.create(SCREEN_WIDTH, SCREEN_HEIGHT)) {
         success = false;
+    } else {
+        //La escena no cambia, se graba una sola vez:
+        SDL_Color white = {0xFF, 0xFF, 0xFF, 0xFF};
+        sceneLayer.clear(white);
+
+        //Un rectangulo rojo relleno:
+        SDL_Rect fillRect = {SCREEN_WIDTH/4, SCREEN_HEIGHT/4, SCREEN_WIDTH/2, SCREEN_HEIGHT/2};
+        SDL_Color red = {0xFF, 0, 0, 0xFF};
+        sceneLayer.fillRect(fillRect, red);
+
+        //Un rectangulo verde:
+        SDL_Rect outlineRect = {SCREEN_WIDTH/6, SCREEN_HEIGHT/6, SCREEN_WIDTH*2/3, SCREEN_HEIGHT*2/3};
+        SDL_Color green = {0, 0xFF, 0, 0xFF};
+        sceneLayer.drawRect(outlineRect, green);
+
+        //Una linea horizontal azul:
+        SDL_Color blue = {0, 0, 0xFF, 0xFF};
+        sceneLayer.drawLine(0, SCREEN_HEIGHT/2, SCREEN_WIDTH, SCREEN_HEIGHT/2, blue);
+
+        //Una linea vertical amarilla de puntos:
+        SDL_Color yellow = {0xFF, 0xFF, 0, 0xFF};
+        for(int i = 0; i < SCREEN_HEIGHT; i += 4) {
+            sceneLayer.drawPoint(SCREEN_WIDTH/2, i, yellow);
+        }
     }
 
     return success;
 }
 
 void close() {
-    targetTexture.free();
+    sceneLayer.free();
+    targetPool.free();
 
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
 
+    //Todo lo creado con los helpers deberia estar liberado ya:
+    if(resources.reportLeaks() > 0) {
+        cout << "Memoria sin liberar: " << resources.getResidentBytes() << " bytes" << endl;
+    }
+
     IMG_Quit();
     SDL_Quit();
 }
 
 int main(int argc, char* argv[]) {
+    parseArgs(argc, argv);
+
     if(init()) {
         if(loadMedia()) {
             bool quit = false;
@@ -253,13 +1137,28 @@ int main(int argc, char* argv[]) {
             SDL_Point screenCenter = {SCREEN_WIDTH/2, SCREEN_HEIGHT/2};
 
             //Pintamos la pantalla de blanco por primera vez:
-            SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-            SDL_RenderClear(renderer);
+            renderDevice.setDrawColor(0xFF, 0xFF, 0xFF, 0xFF);
+            renderDevice.clear();
 
+            //Ultimo titulo puesto con los contadores del renderer:
+            std::string lastTitle;
+
+            //Contador de frames y tiempo para el modo headless:
+            int frame = 0;
+            Uint64 startCounter = SDL_GetPerformanceCounter();
             while(!quit) {
                 while(SDL_PollEvent(&e)) {
                     if(e.type == SDL_QUIT) {
                         quit = true;
+                    } else if(e.type == SDL_RENDER_TARGETS_RESET) {
+                        //El contenido de los render targets se ha perdido:
+                        sceneLayer.markDirty();
+                    } else if(e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED && e.window.data1 > 0 && e.window.data2 > 0) {
+                        //La capa sigue el tamano de la ventana, el pool reutiliza los tamanos ya vistos.
+                        //Al minimizar llega 0x0 y eso se ignora para no quedarnos sin capa:
+                        sceneLayer.create(e.window.data1, e.window.data2);
+                        screenCenter.x = e.window.data1/2;
+                        screenCenter.y = e.window.data2/2;
                     }
                 }
 
@@ -268,41 +1167,32 @@ int main(int argc, char* argv[]) {
                     angle -= 360;
                 }
 
-                //Seteamos la textura como objeto del renderizado:
-                targetTexture.setAsRenderTarget();
-
-                //Limpiamos screen:
-                SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-                SDL_RenderClear(renderer);
+                //Solo componemos la capa ya rasterizada con su rotacion:
+                sceneLayer.render(0, 0, angle, &screenCenter);
 
-                //Renderizamos un rectangulo rojo relleno:
-                SDL_Rect fillRect = {SCREEN_WIDTH/4, SCREEN_HEIGHT/4, SCREEN_WIDTH/2, SCREEN_HEIGHT/2};
-                SDL_SetRenderDrawColor(renderer, 0xFF, 0, 0, 0xFF);
-                SDL_RenderFillRect(renderer, &fillRect);
-
-                //Renderizamos un rectangulo verde:
-                SDL_Rect outlineRect = {SCREEN_WIDTH/6, SCREEN_HEIGHT/6, SCREEN_WIDTH*2/3, SCREEN_HEIGHT*2/3};
-                SDL_SetRenderDrawColor(renderer, 0, 0xFF, 0, 0xFF);
-                SDL_RenderDrawRect(renderer, &outlineRect);
-
-                //Renderizamos una linea horizontal azul:
-                SDL_SetRenderDrawColor(renderer, 0, 0, 0xFF, 0xFF);
-                SDL_RenderDrawLine(renderer, 0, SCREEN_HEIGHT/2, SCREEN_WIDTH, SCREEN_HEIGHT/2);
+                //Presentamos:
+                SDL_RenderPresent(renderer);
 
-                //Dibujamos una linea vertical amarilla de puntos:
-                SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0, 0xFF);
-                for(int i = 0; i < SCREEN_HEIGHT; i += 4) {
-                    SDL_RenderDrawPoint(renderer, SCREEN_WIDTH/2, i);
+                //Contadores del frame en el titulo, solo cuando cambian:
+                renderDevice.endFrame();
+                std::string title = "Render targets - " + describeStats(renderDevice.getFrameStats()) + " - " + describeResources();
+                if(title != lastTitle) {
+                    SDL_SetWindowTitle(window, title.c_str());
+                    lastTitle = title;
                 }
 
-                //Reset del target:
-                SDL_SetRenderTarget(renderer, nullptr);
-
-                //Y renderizamos finalmente la superficie:
-                targetTexture.render(0, 0, nullptr, angle, &screenCenter);
+                frame++;
+                if(headless && frame >= headlessFrames) {
+                    reportFrames(frame, SDL_GetPerformanceCounter() - startCounter);
+                    cout << describeStats(renderDevice.getFrameStats()) << endl;
+                    quit = true;
+                }
 
-                //Presentamos:
-                SDL_RenderPresent(renderer);
+                //Fin de frame para el pool, avisamos si ha tenido que crear o destruir targets:
+                targetPool.endFrame(SDL_GetTicks());
+                if(targetPool.getFrameAllocations() > 0 || targetPool.getFrameReleases() > 0) {
+                    cout << "Render targets: " << targetPool.getFrameAllocations() << " creados, " << targetPool.getFrameReleases() << " destruidos, " << targetPool.getPooledCount() << " en el pool" << endl;
+                }
             }
         }
     }
@@ -1,6 +1,20 @@
 #include <SDL.h>
 #include <string>
+#include <utility>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <iostream>
+#if defined(__SSE2__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
 using namespace std;
 
 const int SCREEN_WIDTH = 640;
@@ -9,10 +23,369 @@ const int SCREEN_HEIGHT = 480;
 SDL_Window *w = NULL;
 SDL_Renderer *renderer = NULL;
 
+//Modo headless para medir rendimiento sin pantalla: driver de video dummy,
+//renderer software sin vsync y un numero fijo de frames:
+bool headless = false;
+int headlessFrames = 0;
+
+//Archivos para grabar o reproducir la entrada (--record, --replay y
+//--replay-fast, que hace los ticks seguidos sin esperar al reloj):
+std::string recordPath;
+std::string replayPath;
+bool replayFast = false;
+
+//Numero de puntos del enjambre, se pide con --dots <numero>:
+int swarmSize = 0;
+//Ticks por segundo de la simulacion (--tick-rate) y ticks a simular sin
+//ventana con --simulate <ticks>:
+const int DEFAULT_TICK_RATE = 60;
+int tickRate = DEFAULT_TICK_RATE;
+int simulateTicks = 0;
+//Si un frame tarda mas que esto no se intenta recuperar todo el tiempo, para
+//no encadenar frames cada vez mas lentos:
+const double MAX_FRAME_TIME = 0.25;
+//Con --sim-thread la simulacion va en su propio hilo y el principal solo dibuja:
+bool simThread = false;
+//Hilos de trabajo con --workers <numero>, por defecto uno por nucleo menos uno:
+int workerCount = -1;
+//Con --check-kernel solo se compara el nucleo SIMD con el escalar:
+bool checkKernel = false;
+
+//Lee --headless <frames> de la linea de comandos:
+void parseArgs(int argc, char* argv[]) {
+    for(int i = 1; i < argc; i++) {
+        if(std::string(argv[i]) == "--headless" && i + 1 < argc) {
+            headless = true;
+            headlessFrames = atoi(argv[++i]);
+        } else if(std::string(argv[i]) == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if(std::string(argv[i]) == "--replay" && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if(std::string(argv[i]) == "--replay-fast" && i + 1 < argc) {
+            replayPath = argv[++i];
+            replayFast = true;
+        } else if(std::string(argv[i]) == "--dots" && i + 1 < argc) {
+            swarmSize = atoi(argv[++i]);
+        } else if(std::string(argv[i]) == "--tick-rate" && i + 1 < argc) {
+            tickRate = max(1, atoi(argv[++i]));
+        } else if(std::string(argv[i]) == "--simulate" && i + 1 < argc) {
+            simulateTicks = atoi(argv[++i]);
+        } else if(std::string(argv[i]) == "--sim-thread") {
+            simThread = true;
+        } else if(std::string(argv[i]) == "--workers" && i + 1 < argc) {
+            workerCount = atoi(argv[++i]);
+        } else if(std::string(argv[i]) == "--check-kernel") {
+            checkKernel = true;
+        }
+    }
+}
+
+//Imprime los frames por segundo al acabar:
+void reportFrames(int frames, Uint64 elapsed) {
+    double seconds = (double)elapsed / SDL_GetPerformanceFrequency();
+    cout << "frames: " << frames << ", segundos: " << seconds << ", fps: " << (seconds > 0 ? frames / seconds : 0) << endl;
+}
+
+//Entrada guionizada del modo headless: el punto da vueltas en cuadrado:
+struct ScriptedKey {
+    int frame;
+    SDL_Keycode key;
+    bool down;
+};
+
+const ScriptedKey INPUT_SCRIPT[] = {
+    {0, SDLK_RIGHT, true},
+    {40, SDLK_RIGHT, false},
+    {40, SDLK_DOWN, true},
+    {80, SDLK_DOWN, false},
+    {80, SDLK_LEFT, true},
+    {120, SDLK_LEFT, false},
+    {120, SDLK_UP, true},
+    {159, SDLK_UP, false}
+};
+const int INPUT_SCRIPT_LENGTH = 8;
+const int INPUT_SCRIPT_PERIOD = 160;
+
+//Mete en la cola de eventos las teclas del guion para este frame:
+void pushScriptedInput(int frame) {
+    int scriptFrame = frame % INPUT_SCRIPT_PERIOD;
+    for(int i = 0; i < INPUT_SCRIPT_LENGTH; i++) {
+        if(INPUT_SCRIPT[i].frame == scriptFrame) {
+            SDL_Event event;
+            memset(&event, 0, sizeof(event));
+            event.type = INPUT_SCRIPT[i].down ? SDL_KEYDOWN : SDL_KEYUP;
+            event.key.keysym.sym = INPUT_SCRIPT[i].key;
+            SDL_PushEvent(&event);
+        }
+    }
+}
+
+//Grabacion y reproduccion de la entrada para poder repetir una sesion exacta.
+//Cada evento se guarda con el tick de simulacion en que se aplico (no el frame:
+//los ticks que caben en un frame dependen del reloj), los ms desde el inicio y
+//solo los campos que usa su tipo:
+const Uint32 EVENT_LOG_MAGIC = 0x32525645; //"EVR2", las "EVR1" iban por frame
+
+bool isRecordable(Uint32 type) {
+    return type == SDL_QUIT || type == SDL_KEYDOWN || type == SDL_KEYUP || type == SDL_TEXTINPUT ||
+           type == SDL_MOUSEMOTION || type == SDL_MOUSEBUTTONDOWN || type == SDL_MOUSEBUTTONUP;
+}
+
+void writeEvent(SDL_RWops *file, const SDL_Event &e) {
+    SDL_WriteLE32(file, e.type);
+    switch(e.type) {
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            SDL_WriteU8(file, e.key.state);
+            SDL_WriteU8(file, e.key.repeat);
+            SDL_WriteLE32(file, e.key.keysym.scancode);
+            SDL_WriteLE32(file, e.key.keysym.sym);
+            SDL_WriteLE16(file, e.key.keysym.mod);
+            break;
+        case SDL_TEXTINPUT: {
+            Uint8 length = (Uint8)strlen(e.text.text);
+            SDL_WriteU8(file, length);
+            SDL_RWwrite(file, e.text.text, 1, length);
+            break;
+        }
+        case SDL_MOUSEMOTION:
+            SDL_WriteLE32(file, e.motion.state);
+            SDL_WriteLE32(file, e.motion.x);
+            SDL_WriteLE32(file, e.motion.y);
+            SDL_WriteLE32(file, e.motion.xrel);
+            SDL_WriteLE32(file, e.motion.yrel);
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            SDL_WriteU8(file, e.button.button);
+            SDL_WriteU8(file, e.button.state);
+            SDL_WriteU8(file, e.button.clicks);
+            SDL_WriteLE32(file, e.button.x);
+            SDL_WriteLE32(file, e.button.y);
+            break;
+    }
+}
+
+//Lecturas que devuelven false si el fichero se acaba a mitad del valor:
+bool readU8(SDL_RWops *file, Uint8 &value) {
+    return SDL_RWread(file, &value, 1, 1) == 1;
+}
+
+bool readLE16(SDL_RWops *file, Uint16 &value) {
+    if(SDL_RWread(file, &value, sizeof(value), 1) != 1) {
+        return false;
+    }
+    value = SDL_SwapLE16(value);
+    return true;
+}
+
+bool readLE32(SDL_RWops *file, Uint32 &value) {
+    if(SDL_RWread(file, &value, sizeof(value), 1) != 1) {
+        return false;
+    }
+    value = SDL_SwapLE32(value);
+    return true;
+}
+
+//Devuelve false si el evento esta cortado o no es de un tipo que se grabe:
+bool readEvent(SDL_RWops *file, SDL_Event &e) {
+    memset(&e, 0, sizeof(e));
+    if(!readLE32(file, e.type)) {
+        return false;
+    }
+
+    bool success = true;
+    switch(e.type) {
+        case SDL_KEYDOWN:
+        case SDL_KEYUP: {
+            Uint32 scancode = 0;
+            Uint32 sym = 0;
+            success = readU8(file, e.key.state) && readU8(file, e.key.repeat) && readLE32(file, scancode) &&
+                      readLE32(file, sym) && readLE16(file, e.key.keysym.mod);
+            e.key.keysym.scancode = (SDL_Scancode)scancode;
+            e.key.keysym.sym = (SDL_Keycode)sym;
+            break;
+        }
+        case SDL_TEXTINPUT: {
+            Uint8 length = 0;
+            success = readU8(file, length) && length < sizeof(e.text.text) && SDL_RWread(file, e.text.text, 1, length) == length;
+            break;
+        }
+        case SDL_MOUSEMOTION: {
+            Uint32 values[4] = {0, 0, 0, 0};
+            success = readLE32(file, e.motion.state) && readLE32(file, values[0]) && readLE32(file, values[1]) &&
+                      readLE32(file, values[2]) && readLE32(file, values[3]);
+            e.motion.x = (Sint32)values[0];
+            e.motion.y = (Sint32)values[1];
+            e.motion.xrel = (Sint32)values[2];
+            e.motion.yrel = (Sint32)values[3];
+            break;
+        }
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP: {
+            Uint32 values[2] = {0, 0};
+            success = readU8(file, e.button.button) && readU8(file, e.button.state) && readU8(file, e.button.clicks) &&
+                      readLE32(file, values[0]) && readLE32(file, values[1]);
+            e.button.x = (Sint32)values[0];
+            e.button.y = (Sint32)values[1];
+            break;
+        }
+        case SDL_QUIT:
+            break;
+        default:
+            success = false;
+            break;
+    }
+    return success;
+}
+
+class EventRecorder {
+    public:
+        ~EventRecorder();
+
+        bool open(std::string path);
+        void close();
+        bool isOpen();
+
+        //Guarda un evento aplicado en el tick dado, si es de entrada:
+        void record(Uint32 tick, const SDL_Event &e);
+
+    private:
+        SDL_RWops *file{nullptr};
+        Uint32 startTime{0};
+};
+
+EventRecorder::~EventRecorder() {
+    close();
+}
+
+bool EventRecorder::open(std::string path) {
+    close();
+
+    file = SDL_RWFromFile(path.c_str(), "wb");
+    if(file == nullptr) {
+        cout << SDL_GetError() << endl;
+        return false;
+    }
+
+    SDL_WriteLE32(file, EVENT_LOG_MAGIC);
+    startTime = SDL_GetTicks();
+
+    return true;
+}
+
+void EventRecorder::close() {
+    if(file != nullptr) {
+        SDL_RWclose(file);
+        file = nullptr;
+    }
+}
+
+bool EventRecorder::isOpen() {
+    return file != nullptr;
+}
+
+void EventRecorder::record(Uint32 tick, const SDL_Event &e) {
+    if(file == nullptr || !isRecordable(e.type)) {
+        return;
+    }
+
+    SDL_WriteLE32(file, tick);
+    SDL_WriteLE32(file, SDL_GetTicks() - startTime);
+    writeEvent(file, e);
+}
+
+class EventReplayer {
+    public:
+        bool open(std::string path);
+        void close();
+        bool isOpen();
+        bool isFinished();
+
+        //Anade a events los eventos grabados hasta este tick. El ritmo lo marcan
+        //los ticks, asi que no hay que esperar al tiempo en que se grabaron:
+        void takeEvents(Uint32 tick, vector<SDL_Event> &events);
+
+    private:
+        struct RecordedEvent {
+            Uint32 tick;
+            Uint32 time;
+            SDL_Event event;
+        };
+
+        vector<RecordedEvent> events;
+        size_t next{0};
+        bool loaded{false};
+};
+
+bool EventReplayer::open(std::string path) {
+    close();
+
+    SDL_RWops *file = SDL_RWFromFile(path.c_str(), "rb");
+    if(file == nullptr) {
+        cout << SDL_GetError() << endl;
+        return false;
+    }
+
+    Uint32 magic = 0;
+    if(!readLE32(file, magic) || magic != EVENT_LOG_MAGIC) {
+        cout << "El archivo " << path << " no es una grabacion de eventos" << endl;
+        SDL_RWclose(file);
+        return false;
+    }
+
+    //Si la grabacion se corto (por ejemplo al matar el programa) se reproduce
+    //hasta el ultimo evento completo y no se mete nada a medio leer:
+    RecordedEvent recorded;
+    while(readLE32(file, recorded.tick)) {
+        if(!readLE32(file, recorded.time) || !readEvent(file, recorded.event)) {
+            cout << "La grabacion " << path << " esta cortada, se para en el evento " << events.size() << endl;
+            break;
+        }
+        events.push_back(recorded);
+    }
+    SDL_RWclose(file);
+
+    next = 0;
+    loaded = true;
+
+    return true;
+}
+
+void EventReplayer::close() {
+    events.clear();
+    next = 0;
+    loaded = false;
+}
+
+bool EventReplayer::isOpen() {
+    return loaded;
+}
+
+bool EventReplayer::isFinished() {
+    return next >= events.size();
+}
+
+void EventReplayer::takeEvents(Uint32 tick, vector<SDL_Event> &events) {
+    while(next < this->events.size() && this->events[next].tick <= tick) {
+        events.push_back(this->events[next].event);
+        next++;
+    }
+}
+
+EventRecorder recorder;
+EventReplayer replayer;
+
 class Texture {
     public:
         Texture();
         ~Texture();
+
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
         bool loadFromFile(string path);
         void free();
         void render(int x, int y);
@@ -34,6 +407,23 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 bool Texture::loadFromFile(string path) {
     SDL_Surface *surf = SDL_LoadBMP(path.c_str());
     if(surf == NULL) {
@@ -55,6 +445,7 @@ bool Texture::loadFromFile(string path) {
 void Texture::free() {
     if(texture != NULL) {
         SDL_DestroyTexture(texture);
+        texture = NULL;
         width = 0;
         height = 0;
     }
@@ -83,6 +474,9 @@ class Dot {
         float y{0};
         float vx{0};
         float vy{0};
+        //Posicion del tick anterior, para interpolar al renderizar:
+        float prevX{0};
+        float prevY{0};
     public:
         //Velocidad y tamao de todos los puntos:
         static const int VEL = 640;
@@ -92,9 +486,10 @@ class Dot {
         //Handle de eventos:
         void handleEvent(SDL_Event &e);
 
-        //Metodos para mover y renderizar el punto:
+        //Metodos para mover y renderizar el punto. alpha es cuanto se ha
+        //avanzado desde el tick anterior hacia el actual (0 a 1):
         void move(float timeStep);
-        void render();
+        void render(float alpha = 1.f);
 };
 
 void Dot::handleEvent(SDL_Event &e) {
@@ -137,6 +532,9 @@ void Dot::handleEvent(SDL_Event &e) {
 
 //Movemos el punto gestionando los bordes de pantalla:
 void Dot::move(float timeStep) {
+    prevX = x;
+    prevY = y;
+
     x += vx * timeStep;
     if(x < 0) {
         x = 0;
@@ -151,14 +549,885 @@ void Dot::move(float timeStep) {
     }
 }
 
-//Renderizamos la textura en la posicion del punto:
-void Dot::render() {
-    dotTexture.render((int)x, (int)y);
+//Renderizamos la textura entre la posicion anterior y la actual:
+void Dot::render(float alpha) {
+    dotTexture.render((int)(prevX + (x - prevX) * alpha), (int)(prevY + (y - prevY) * alpha));
+}
+
+//Almacen de puntos como estructura de arrays: cada campo va en su propio
+//array contiguo y los sistemas de abajo recorren solo los que usan. Asi caben
+//muchos mas puntos que con un objeto Dot por punto:
+class DotStore {
+    public:
+        //Anade un punto y devuelve su indice:
+        int add(float x, float y, float vx, float vy, Texture *sprite);
+        void reserve(int count);
+        void clear();
+        int size();
+
+        //Posicion y velocidad:
+        vector<float> posX;
+        vector<float> posY;
+        //Posicion del tick anterior, para interpolar:
+        vector<float> prevX;
+        vector<float> prevY;
+        vector<float> velX;
+        vector<float> velY;
+        //Tamano del collider:
+        vector<float> width;
+        vector<float> height;
+        //Textura con la que se dibuja:
+        vector<Texture*> sprite;
+};
+
+int DotStore::add(float x, float y, float vx, float vy, Texture *texture) {
+    posX.push_back(x);
+    posY.push_back(y);
+    prevX.push_back(x);
+    prevY.push_back(y);
+    velX.push_back(vx);
+    velY.push_back(vy);
+    width.push_back(Dot::WIDTH);
+    height.push_back(Dot::HEIGHT);
+    sprite.push_back(texture);
+    return posX.size() - 1;
+}
+
+void DotStore::reserve(int count) {
+    posX.reserve(count);
+    posY.reserve(count);
+    prevX.reserve(count);
+    prevY.reserve(count);
+    velX.reserve(count);
+    velY.reserve(count);
+    width.reserve(count);
+    height.reserve(count);
+    sprite.reserve(count);
+}
+
+void DotStore::clear() {
+    posX.clear();
+    posY.clear();
+    prevX.clear();
+    prevY.clear();
+    velX.clear();
+    velY.clear();
+    width.clear();
+    height.clear();
+    sprite.clear();
+}
+
+int DotStore::size() {
+    return posX.size();
+}
+
+//Sistema de render: dibuja cada punto con su textura en la posicion ya
+//preparada, las llamadas a SDL solo se hacen desde el hilo principal:
+void renderDots(const vector<Texture*> &sprites, const vector<SDL_Point> &points) {
+    int count = points.size();
+    for(int i = 0; i < count; i++) {
+        sprites[i]->render(points[i].x, points[i].y);
+    }
+}
+
+//Puntos que rebotan solos por la pantalla:
+DotStore swarm;
+
+//Llena el enjambre con posiciones y velocidades aleatorias pero repetibles:
+void spawnSwarm(DotStore &dots, int count, Texture *texture) {
+    srand(count);
+    dots.clear();
+    dots.reserve(count);
+    for(int i = 0; i < count; i++) {
+        float x = rand() % (SCREEN_WIDTH - Dot::WIDTH);
+        float y = rand() % (SCREEN_HEIGHT - Dot::HEIGHT);
+        float vx = (rand() % (2 * Dot::VEL + 1)) - Dot::VEL;
+        float vy = (rand() % (2 * Dot::VEL + 1)) - Dot::VEL;
+        dots.add(x, y, vx, vy, texture);
+    }
+}
+
+//Nucleo de movimiento de un eje: integra la velocidad, deja el punto dentro
+//de [0, limit - size] y le invierte la velocidad si se habia salido. No tiene
+//ramas y la version escalar hace las mismas operaciones que las SIMD (mul y
+//luego add, max/min como los de SSE y cambio de signo), asi que dan los mismos
+//bits. Para eso el compilador no puede fusionar la escalar en un FMA: los
+//pragmas de abajo lo prohiben solo en los nucleos, sea cual sea -ffp-contract
+//(-ffast-math sigue rompiendolo):
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+void integrateAxisScalar(float *pos, float *vel, const float *size, float limit, float timeStep, int first, int count) {
+    for(int i = first; i < count; i++) {
+        float p = pos[i] + vel[i] * timeStep;
+        float high = limit - size[i];
+        bool out = (p < 0.f) | (p > high);
+        p = p > 0.f ? p : 0.f;
+        p = p < high ? p : high;
+        pos[i] = p;
+        vel[i] = out ? -vel[i] : vel[i];
+    }
+}
+
+#if defined(__SSE2__)
+//Cuatro puntos por iteracion, devuelve cuantos ha procesado:
+int integrateAxisSSE(float *pos, float *vel, const float *size, float limit, float timeStep, int count) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 limits = _mm_set1_ps(limit);
+    const __m128 step = _mm_set1_ps(timeStep);
+    const __m128 sign = _mm_set1_ps(-0.f);
+
+    int i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128 v = _mm_loadu_ps(vel + i);
+        __m128 p = _mm_add_ps(_mm_loadu_ps(pos + i), _mm_mul_ps(v, step));
+        __m128 high = _mm_sub_ps(limits, _mm_loadu_ps(size + i));
+        __m128 out = _mm_or_ps(_mm_cmplt_ps(p, zero), _mm_cmpgt_ps(p, high));
+        p = _mm_min_ps(_mm_max_ps(p, zero), high);
+        _mm_storeu_ps(pos + i, p);
+        _mm_storeu_ps(vel + i, _mm_xor_ps(v, _mm_and_ps(out, sign)));
+    }
+    return i;
+}
+#endif
+
+#if defined(__AVX__)
+//Ocho puntos por iteracion, devuelve cuantos ha procesado:
+int integrateAxisAVX(float *pos, float *vel, const float *size, float limit, float timeStep, int count) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 limits = _mm256_set1_ps(limit);
+    const __m256 step = _mm256_set1_ps(timeStep);
+    const __m256 sign = _mm256_set1_ps(-0.f);
+
+    int i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_loadu_ps(vel + i);
+        __m256 p = _mm256_add_ps(_mm256_loadu_ps(pos + i), _mm256_mul_ps(v, step));
+        __m256 high = _mm256_sub_ps(limits, _mm256_loadu_ps(size + i));
+        __m256 out = _mm256_or_ps(_mm256_cmp_ps(p, zero, _CMP_LT_OQ), _mm256_cmp_ps(p, high, _CMP_GT_OQ));
+        p = _mm256_min_ps(_mm256_max_ps(p, zero), high);
+        _mm256_storeu_ps(pos + i, p);
+        _mm256_storeu_ps(vel + i, _mm256_xor_ps(v, _mm256_and_ps(out, sign)));
+    }
+    return i;
+}
+#endif
+
+//Usa el conjunto de instrucciones mas ancho con el que se ha compilado y
+//termina con la escalar los que no llenan un registro:
+void integrateAxis(float *pos, float *vel, const float *size, float limit, float timeStep, int count) {
+    int done = 0;
+#if defined(__AVX__)
+    done = integrateAxisAVX(pos, vel, size, limit, timeStep, count);
+#elif defined(__SSE2__)
+    done = integrateAxisSSE(pos, vel, size, limit, timeStep, count);
+#endif
+    integrateAxisScalar(pos, vel, size, limit, timeStep, done, count);
+}
+
+//Sistema de movimiento y colisiones: mueve todos los puntos y los hace rebotar
+//contra los bordes de la pantalla:
+void updateDots(DotStore &dots, float timeStep) {
+    int count = dots.size();
+    integrateAxis(dots.posX.data(), dots.velX.data(), dots.width.data(), SCREEN_WIDTH, timeStep, count);
+    integrateAxis(dots.posY.data(), dots.velY.data(), dots.height.data(), SCREEN_HEIGHT, timeStep, count);
+}
+
+//Lo mismo solo con la version escalar, para comparar:
+void updateDotsScalar(DotStore &dots, float timeStep) {
+    int count = dots.size();
+    integrateAxisScalar(dots.posX.data(), dots.velX.data(), dots.width.data(), SCREEN_WIDTH, timeStep, 0, count);
+    integrateAxisScalar(dots.posY.data(), dots.velY.data(), dots.height.data(), SCREEN_HEIGHT, timeStep, 0, count);
+}
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT DEFAULT
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+//Comprueba que la version SIMD da los mismos bits que la escalar (--check-kernel):
+bool checkDotKernel() {
+    DotStore simd;
+    DotStore scalar;
+    spawnSwarm(simd, 1003, nullptr);
+    spawnSwarm(scalar, 1003, nullptr);
+
+    for(int step = 0; step < 1000; step++) {
+        float timeStep = (step % 7 + 1) / 100.f;
+        updateDots(simd, timeStep);
+        updateDotsScalar(scalar, timeStep);
+    }
+
+    bool same = memcmp(simd.posX.data(), scalar.posX.data(), simd.size() * sizeof(float)) == 0 &&
+                memcmp(simd.posY.data(), scalar.posY.data(), simd.size() * sizeof(float)) == 0 &&
+                memcmp(simd.velX.data(), scalar.velX.data(), simd.size() * sizeof(float)) == 0 &&
+                memcmp(simd.velY.data(), scalar.velY.data(), simd.size() * sizeof(float)) == 0;
+    cout << "Nucleo de puntos: " << (same ? "SIMD y escalar coinciden" : "SIMD y escalar NO coinciden") << endl;
+    return same;
+}
+
+//Sistema de trabajos con robo de tareas. Cada hilo (el principal es el 0) tiene
+//su propia cola: saca de su final los trabajos que mete y, si se queda sin
+//nada, roba del principio de la cola de otro. Solo reparte calculo, las
+//llamadas de SDL de render se siguen haciendo en el hilo principal.
+class JobSystem {
+    public:
+        JobSystem();
+        ~JobSystem();
+
+        //Arranca los hilos, con -1 uno por nucleo menos el principal. extraThreads
+        //reserva colas para otros hilos propios que tambien lanzan trabajos:
+        bool init(int workerCount = -1, int extraThreads = 0);
+        //Da a este hilo una de las colas reservadas, devuelve false si no quedan:
+        bool registerThread();
+        void shutdown();
+        int getThreadCount();
+
+        //Reparte [0, count) en trozos de grain elementos y espera a que acaben:
+        void parallelFor(int count, int grain, std::function<void(int begin, int end)> body);
+
+        //Estadisticas desde el ultimo resetStats: % de tiempo ocupado y robos por hilo:
+        void resetStats();
+        void reportStats();
+
+    private:
+        friend class TaskGraph;
+
+        struct Job {
+            std::function<void()> work;
+            //Contador del grupo al que pertenece, se decrementa al acabar:
+            std::atomic<int> *pending;
+        };
+
+        struct Worker {
+            JobSystem *system{nullptr};
+            int index{0};
+            std::mutex mutex;
+            std::deque<Job> jobs;
+            SDL_Thread *thread{nullptr};
+            //Contadores de este hilo:
+            std::atomic<Uint64> busyTicks{0};
+            std::atomic<int> executed{0};
+            std::atomic<int> steals{0};
+        };
+
+        static int workerThread(void *data);
+
+        void push(Job job);
+        //Con group solo se cogen trabajos de ese grupo, nullptr para cualquiera:
+        bool pop(int index, Job &job, std::atomic<int> *group);
+        bool steal(int index, Job &job, std::atomic<int> *group);
+        //Ejecuta un trabajo si encuentra alguno, devuelve false si no habia:
+        bool runOne(int index, std::atomic<int> *group = nullptr);
+        //Espera a que el contador llegue a 0 ayudando solo con los trabajos de
+        //ese grupo. Asi quien espera no se mete en el trabajo de otro hilo (el
+        //render no acaba haciendo un tick de la simulacion):
+        void wait(std::atomic<int> &pending);
+
+        std::vector<Worker*> workers;
+        //Siguiente cola reservada libre para registerThread:
+        std::atomic<int> nextExtra{0};
+        std::atomic<bool> running{false};
+        std::atomic<int> queued{0};
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        Uint64 statsStart{0};
+};
+
+//Indice del hilo actual dentro del sistema de trabajos, el principal es el 0
+//(un hilo propio tiene que pedir el suyo con registerThread para no compartir
+//la cola del principal), y cuantos trabajos hay anidados en este hilo:
+thread_local int jobWorkerIndex = 0;
+thread_local int jobDepth = 0;
+
+JobSystem::JobSystem() {
+}
+
+JobSystem::~JobSystem() {
+    shutdown();
+}
+
+bool JobSystem::init(int workerCount, int extraThreads) {
+    shutdown();
+
+    if(workerCount < 0) {
+        workerCount = max(0, SDL_GetCPUCount() - 1);
+    }
+
+    //Hueco 0 para el hilo principal, que tambien ejecuta trabajos mientras espera:
+    workers.push_back(new Worker());
+    running = true;
+    for(int i = 1; i <= workerCount; i++) {
+        Worker *worker = new Worker();
+        worker->system = this;
+        worker->index = i;
+        workers.push_back(worker);
+    }
+    //Las colas reservadas van detras, sin hilo de trabajo propio:
+    nextExtra = workers.size();
+    for(int i = 0; i < extraThreads; i++) {
+        Worker *worker = new Worker();
+        worker->system = this;
+        worker->index = workers.size();
+        workers.push_back(worker);
+    }
+    for(int i = 1; i <= workerCount; i++) {
+        workers[i]->thread = SDL_CreateThread(workerThread, "JobWorker", workers[i]);
+        if(workers[i]->thread == nullptr) {
+            cout << "No se ha podido crear el hilo de trabajo: " << SDL_GetError() << endl;
+            shutdown();
+            return false;
+        }
+    }
+
+    resetStats();
+    return true;
+}
+
+void JobSystem::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        running = false;
+    }
+    wake.notify_all();
+
+    for(unsigned int i = 0; i < workers.size(); i++) {
+        if(workers[i]->thread != nullptr) {
+            SDL_WaitThread(workers[i]->thread, nullptr);
+        }
+    }
+    for(unsigned int i = 0; i < workers.size(); i++) {
+        delete workers[i];
+    }
+    workers.clear();
+}
+
+bool JobSystem::registerThread() {
+    int index = nextExtra++;
+    if(index >= (int)workers.size()) {
+        return false;
+    }
+    jobWorkerIndex = index;
+    return true;
+}
+
+int JobSystem::getThreadCount() {
+    return workers.size();
+}
+
+void JobSystem::push(Job job) {
+    Worker *worker = workers[jobWorkerIndex];
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->jobs.push_back(job);
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+bool JobSystem::pop(int index, Job &job, std::atomic<int> *group) {
+    Worker *worker = workers[index];
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    //La propia cola se saca por detras, lo ultimo que se metio:
+    for(int i = (int)worker->jobs.size() - 1; i >= 0; i--) {
+        if(group == nullptr || worker->jobs[i].pending == group) {
+            job = worker->jobs[i];
+            worker->jobs.erase(worker->jobs.begin() + i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JobSystem::steal(int index, Job &job, std::atomic<int> *group) {
+    int count = workers.size();
+    for(int offset = 1; offset < count; offset++) {
+        Worker *victim = workers[(index + offset) % count];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        //Y las de los demas por delante, lo mas antiguo:
+        for(unsigned int i = 0; i < victim->jobs.size(); i++) {
+            if(group == nullptr || victim->jobs[i].pending == group) {
+                job = victim->jobs[i];
+                victim->jobs.erase(victim->jobs.begin() + i);
+                workers[index]->steals++;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool JobSystem::runOne(int index, std::atomic<int> *group) {
+    Job job;
+    if(!pop(index, job, group) && !steal(index, job, group)) {
+        return false;
+    }
+    queued--;
+
+    //Solo medimos el trabajo de fuera, el anidado ya cuenta dentro de el:
+    bool outermost = jobDepth++ == 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+    job.work();
+    if(outermost) {
+        workers[index]->busyTicks += SDL_GetPerformanceCounter() - start;
+    }
+    jobDepth--;
+    workers[index]->executed++;
+
+    if(job.pending != nullptr) {
+        job.pending->fetch_sub(1);
+    }
+    return true;
+}
+
+void JobSystem::wait(std::atomic<int> &pending) {
+    while(pending.load() > 0) {
+        if(!runOne(jobWorkerIndex, &pending)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+int JobSystem::workerThread(void *data) {
+    Worker *worker = (Worker*)data;
+    jobWorkerIndex = worker->index;
+    JobSystem &system = *worker->system;
+
+    while(system.running) {
+        if(!system.runOne(jobWorkerIndex)) {
+            //Sin trabajo en ninguna cola, dormimos hasta que metan mas:
+            std::unique_lock<std::mutex> lock(system.sleepMutex);
+            system.wake.wait(lock, [&system]() { return !system.running || system.queued > 0; });
+        }
+    }
+    return 0;
+}
+
+void JobSystem::parallelFor(int count, int grain, std::function<void(int begin, int end)> body) {
+    //Sin hilos o con poco trabajo no compensa repartir:
+    if(workers.size() <= 1 || count <= grain) {
+        body(0, count);
+        return;
+    }
+
+    std::atomic<int> pending{(count + grain - 1) / grain};
+    for(int begin = 0; begin < count; begin += grain) {
+        int end = min(begin + grain, count);
+        Job job = {[&body, begin, end]() { body(begin, end); }, &pending};
+        push(job);
+    }
+    wait(pending);
+}
+
+void JobSystem::resetStats() {
+    for(unsigned int i = 0; i < workers.size(); i++) {
+        workers[i]->busyTicks = 0;
+        workers[i]->executed = 0;
+        workers[i]->steals = 0;
+    }
+    statsStart = SDL_GetPerformanceCounter();
+}
+
+void JobSystem::reportStats() {
+    Uint64 elapsed = SDL_GetPerformanceCounter() - statsStart;
+    for(unsigned int i = 0; i < workers.size(); i++) {
+        double utilization = elapsed > 0 ? 100.0 * workers[i]->busyTicks / elapsed : 0;
+        cout << "Hilo " << i << (i == 0 ? " (principal)" : workers[i]->thread == nullptr ? " (externo)" : "") << ": " << utilization << "% ocupado, "
+             << workers[i]->executed << " trabajos, " << workers[i]->steals << " robados" << endl;
+    }
+}
+
+//Grafo de tareas: cada tarea se lanza cuando han acabado todas las que la
+//preceden. run() bloquea hasta que acaba todo el grafo:
+class TaskGraph {
+    public:
+        int add(std::function<void()> work);
+        //La tarea after no empieza hasta que acabe before:
+        void precede(int before, int after);
+        void clear();
+
+        void run(JobSystem &system);
+
+    private:
+        struct Task {
+            std::function<void()> work;
+            std::vector<int> successors;
+            int dependencies;
+        };
+
+        void schedule(JobSystem &system, int task, std::atomic<int> &pending);
+
+        std::vector<Task> tasks;
+        //Dependencias que le faltan a cada tarea en la ejecucion en curso:
+        std::vector<std::atomic<int>> remaining;
+};
+
+int TaskGraph::add(std::function<void()> work) {
+    Task task = {work, std::vector<int>(), 0};
+    tasks.push_back(task);
+    return tasks.size() - 1;
+}
+
+void TaskGraph::precede(int before, int after) {
+    tasks[before].successors.push_back(after);
+    tasks[after].dependencies++;
+}
+
+void TaskGraph::clear() {
+    tasks.clear();
+}
+
+void TaskGraph::run(JobSystem &system) {
+    remaining = std::vector<std::atomic<int>>(tasks.size());
+    for(unsigned int i = 0; i < tasks.size(); i++) {
+        remaining[i] = tasks[i].dependencies;
+    }
+
+    std::atomic<int> pending{(int)tasks.size()};
+    for(unsigned int i = 0; i < tasks.size(); i++) {
+        if(tasks[i].dependencies == 0) {
+            schedule(system, i, pending);
+        }
+    }
+    system.wait(pending);
+}
+
+void TaskGraph::schedule(JobSystem &system, int task, std::atomic<int> &pending) {
+    JobSystem::Job job = {[this, &system, task, &pending]() {
+        tasks[task].work();
+        //Las sucesoras que se quedan sin dependencias ya se pueden lanzar:
+        for(unsigned int i = 0; i < tasks[task].successors.size(); i++) {
+            int successor = tasks[task].successors[i];
+            if(remaining[successor].fetch_sub(1) == 1) {
+                schedule(system, successor, pending);
+            }
+        }
+    }, &pending};
+    system.push(job);
 }
 
+JobSystem jobs;
+
+//Puntos del enjambre que se reparten a cada hilo de golpe:
+const int DOT_GRAIN = 16384;
+
+//Posiciones en pantalla de cada punto, interpoladas para el render:
+vector<SDL_Point> swarmPoints;
+
+//Tick del enjambre como grafo: los dos ejes se mueven a la vez, cada uno
+//repartido entre los hilos. Antes de mover se guarda la posicion anterior:
+void updateSwarm(float timeStep) {
+    int count = swarm.size();
+
+    TaskGraph graph;
+    graph.add([count, timeStep]() {
+        jobs.parallelFor(count, DOT_GRAIN, [timeStep](int begin, int end) {
+            memcpy(swarm.prevX.data() + begin, swarm.posX.data() + begin, (end - begin) * sizeof(float));
+            integrateAxis(swarm.posX.data() + begin, swarm.velX.data() + begin, swarm.width.data() + begin, SCREEN_WIDTH, timeStep, end - begin);
+        });
+    });
+    graph.add([count, timeStep]() {
+        jobs.parallelFor(count, DOT_GRAIN, [timeStep](int begin, int end) {
+            memcpy(swarm.prevY.data() + begin, swarm.posY.data() + begin, (end - begin) * sizeof(float));
+            integrateAxis(swarm.posY.data() + begin, swarm.velY.data() + begin, swarm.height.data() + begin, SCREEN_HEIGHT, timeStep, end - begin);
+        });
+    });
+    graph.run(jobs);
+}
+
+//Prepara las posiciones de dibujo entre el tick anterior y el actual:
+void prepareDots(const float *prevX, const float *prevY, const float *posX, const float *posY, int count, float alpha) {
+    swarmPoints.resize(count);
+
+    jobs.parallelFor(count, DOT_GRAIN, [=](int begin, int end) {
+        for(int i = begin; i < end; i++) {
+            swarmPoints[i].x = (int)(prevX[i] + (posX[i] - prevX[i]) * alpha);
+            swarmPoints[i].y = (int)(prevY[i] + (posY[i] - prevY[i]) * alpha);
+        }
+    });
+}
+
+void prepareSwarm(float alpha) {
+    prepareDots(swarm.prevX.data(), swarm.prevY.data(), swarm.posX.data(), swarm.posY.data(), swarm.size(), alpha);
+}
+
+//Solo simulacion, sin ventana ni render, lo mas rapido posible (--simulate):
+int runSimulation(int ticks, float tickStep) {
+    spawnSwarm(swarm, swarmSize, nullptr);
+    if(!jobs.init(workerCount)) {
+        return 1;
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for(int tick = 0; tick < ticks; tick++) {
+        updateSwarm(tickStep);
+    }
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+    //Suma de posiciones para comparar ejecuciones:
+    double checksum = 0;
+    for(int i = 0; i < swarm.size(); i++) {
+        checksum += swarm.posX[i] + swarm.posY[i];
+    }
+    cout << "ticks: " << ticks << ", puntos: " << swarm.size() << ", segundos: " << seconds
+         << ", ticks/s: " << (seconds > 0 ? ticks / seconds : 0) << ", checksum: " << checksum << endl;
+
+    jobs.reportStats();
+    jobs.shutdown();
+    return 0;
+}
+
+//Entrada de un tick: se le anade la grabada si se esta reproduciendo, se graba
+//si se pidio y se aplica al punto. Devuelve true si habia un SDL_QUIT:
+bool applyTickInput(Uint32 tick, vector<SDL_Event> &input, Dot &dot) {
+    if(replayer.isOpen()) {
+        replayer.takeEvents(tick, input);
+    }
+
+    bool quit = false;
+    for(unsigned int i = 0; i < input.size(); i++) {
+        recorder.record(tick, input[i]);
+        if(input[i].type == SDL_QUIT) {
+            quit = true;
+        }
+        dot.handleEvent(input[i]);
+    }
+    input.clear();
+
+    return quit;
+}
+
+//Triple buffer entre un escritor y un lector: el escritor rellena su buffer y
+//lo publica intercambiandolo con el del medio, y el lector se queda con el del
+//medio solo si hay uno nuevo. Ninguno espera nunca al otro:
+template<typename T>
+class TripleBuffer {
+    public:
+        //Lado del escritor:
+        T &getWriteBuffer();
+        void publish();
+
+        //Lado del lector, devuelve true si habia uno nuevo:
+        bool acquire();
+        T &getReadBuffer();
+
+    private:
+        //Bit que marca que el buffer del medio no lo ha leido nadie todavia:
+        static const int FRESH = 4;
+        static const int INDEX_MASK = 3;
+
+        T buffers[3];
+        std::atomic<int> middle{1};
+        int writeIndex{0};
+        int readIndex{2};
+};
+
+template<typename T>
+T &TripleBuffer<T>::getWriteBuffer() {
+    return buffers[writeIndex];
+}
+
+template<typename T>
+void TripleBuffer<T>::publish() {
+    writeIndex = middle.exchange(writeIndex | FRESH) & INDEX_MASK;
+}
+
+template<typename T>
+bool TripleBuffer<T>::acquire() {
+    if((middle.load() & FRESH) == 0) {
+        return false;
+    }
+    readIndex = middle.exchange(readIndex) & INDEX_MASK;
+    return true;
+}
+
+template<typename T>
+T &TripleBuffer<T>::getReadBuffer() {
+    return buffers[readIndex];
+}
+
+//Foto del estado de la simulacion al acabar un tick, el render solo lee esto:
+struct SimSnapshot {
+    Uint32 tick{0};
+    //Contador de rendimiento del momento al que corresponde el tick:
+    Uint64 time{0};
+    Dot dot;
+    vector<float> prevX;
+    vector<float> prevY;
+    vector<float> posX;
+    vector<float> posY;
+    vector<Texture*> sprite;
+};
+
+//Simulacion en su propio hilo (--sim-thread): hace sus ticks fijos con su
+//propio reloj, sin esperar al vsync del render, y publica una foto tras cada
+//tanda de ticks. La entrada le llega desde el hilo principal con pushInput:
+class SimulationThread {
+    public:
+        ~SimulationThread();
+
+        bool start(float tickStep);
+        void stop();
+
+        //Desde el hilo principal, se aplica en el siguiente tick:
+        void pushInput(const SDL_Event &e);
+        //True cuando un tick ha aplicado un SDL_QUIT, real o reproducido:
+        bool hasQuit();
+        //Se queda con la foto mas reciente, devuelve true si era nueva:
+        bool acquireSnapshot();
+        SimSnapshot &getSnapshot();
+        Uint32 getTickCount();
+
+    private:
+        static int simulationThread(void *data);
+        void run();
+        void publish(Uint64 time, Uint32 tick);
+
+        Dot dot;
+        float tickStep{0};
+        TripleBuffer<SimSnapshot> snapshots;
+
+        std::mutex inputMutex;
+        vector<SDL_Event> pendingInput;
+
+        SDL_Thread *thread{nullptr};
+        std::atomic<bool> running{false};
+        std::atomic<bool> quitRequested{false};
+        std::atomic<Uint32> ticks{0};
+};
+
+SimulationThread::~SimulationThread() {
+    stop();
+}
+
+bool SimulationThread::start(float step) {
+    tickStep = step;
+    running = true;
+    thread = SDL_CreateThread(simulationThread, "Simulation", this);
+    if(thread == nullptr) {
+        cout << "No se ha podido crear el hilo de simulacion: " << SDL_GetError() << endl;
+        running = false;
+        return false;
+    }
+    return true;
+}
+
+void SimulationThread::stop() {
+    running = false;
+    if(thread != nullptr) {
+        SDL_WaitThread(thread, nullptr);
+        thread = nullptr;
+    }
+}
+
+void SimulationThread::pushInput(const SDL_Event &e) {
+    std::lock_guard<std::mutex> lock(inputMutex);
+    pendingInput.push_back(e);
+}
+
+bool SimulationThread::hasQuit() {
+    return quitRequested;
+}
+
+bool SimulationThread::acquireSnapshot() {
+    return snapshots.acquire();
+}
+
+SimSnapshot &SimulationThread::getSnapshot() {
+    return snapshots.getReadBuffer();
+}
+
+Uint32 SimulationThread::getTickCount() {
+    return ticks;
+}
+
+int SimulationThread::simulationThread(void *data) {
+    ((SimulationThread*)data)->run();
+    return 0;
+}
+
+void SimulationThread::run() {
+    //Cola propia en el sistema de trabajos, la 0 es del hilo principal:
+    if(!jobs.registerThread()) {
+        cout << "No queda cola en el sistema de trabajos para el hilo de simulacion" << endl;
+        quitRequested = true;
+        return;
+    }
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 lastCounter = SDL_GetPerformanceCounter();
+    double accumulator = 0;
+    vector<SDL_Event> input;
+
+    publish(lastCounter, 0);
+    while(running) {
+        Uint64 now = SDL_GetPerformanceCounter();
+        if(replayFast && replayer.isOpen()) {
+            //Reproduccion rapida: un tick detras de otro sin mirar el reloj:
+            accumulator = tickStep;
+        } else {
+            accumulator += (double)(now - lastCounter) / frequency;
+            accumulator = min(accumulator, MAX_FRAME_TIME);
+        }
+        lastCounter = now;
+
+        if(accumulator < tickStep) {
+            //Todavia no toca tick, dejamos la CPU un momento:
+            SDL_Delay(1);
+            continue;
+        }
+
+        while(accumulator >= tickStep) {
+            {
+                std::lock_guard<std::mutex> lock(inputMutex);
+                input.swap(pendingInput);
+            }
+            //Con este hilo en marcha solo el toca la grabacion y la reproduccion:
+            if(applyTickInput(ticks, input, dot)) {
+                quitRequested = true;
+            }
+
+            dot.move(tickStep);
+            updateSwarm(tickStep);
+            accumulator -= tickStep;
+            ticks++;
+        }
+
+        //El estado corresponde al momento en que se alcanzo el ultimo tick:
+        publish(now - (Uint64)(accumulator * frequency), ticks);
+    }
+}
+
+void SimulationThread::publish(Uint64 time, Uint32 tick) {
+    SimSnapshot &snapshot = snapshots.getWriteBuffer();
+    snapshot.tick = tick;
+    snapshot.time = time;
+    snapshot.dot = dot;
+    //Al reutilizar los buffers, assign no vuelve a reservar memoria:
+    snapshot.prevX.assign(swarm.prevX.begin(), swarm.prevX.end());
+    snapshot.prevY.assign(swarm.prevY.begin(), swarm.prevY.end());
+    snapshot.posX.assign(swarm.posX.begin(), swarm.posX.end());
+    snapshot.posY.assign(swarm.posY.begin(), swarm.posY.end());
+    snapshot.sprite.assign(swarm.sprite.begin(), swarm.sprite.end());
+    snapshots.publish();
+}
+
+SimulationThread simulation;
+
 bool init() {
     bool success = true;
 
+    //En modo headless no hay pantalla, usamos el driver dummy:
+    if(headless) {
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    }
+
     if(SDL_Init(SDL_INIT_VIDEO) < 0) {
         cout << SDL_GetError() << endl;
         success = false;
@@ -168,7 +1437,7 @@ bool init() {
             cout << SDL_GetError() << endl;
             success = false;
         } else {
-            renderer = SDL_CreateRenderer(w, -1, SDL_RENDERER_ACCELERATED);
+            renderer = SDL_CreateRenderer(w, -1, headless ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED);
             if(renderer == NULL) {
                 cout << SDL_GetError() << endl;
                 success = false;
@@ -190,43 +1459,145 @@ bool loadMedia() {
 }
 
 void close() {
+    simulation.stop();
+    if(swarm.size() > 0) {
+        jobs.reportStats();
+    }
+    jobs.shutdown();
     dotTexture.free();
+    recorder.close();
+    replayer.close();
+
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(w);
     SDL_Quit();
 }
 
+//benchmark.cpp incluye este archivo para medir los nucleos de los puntos, sin su main:
+#ifndef LESSON_NO_MAIN
 int main(int argc, char* args[]) {
+    parseArgs(argc, args);
+    if(checkKernel) {
+        return checkDotKernel() ? 0 : 1;
+    }
+    if(simulateTicks > 0) {
+        return runSimulation(simulateTicks, 1.f / tickRate);
+    }
+
     if(init()) {
         if(loadMedia()) {
             bool quit = false;
             SDL_Event e;
             Dot dot;
+            spawnSwarm(swarm, swarmSize, &dotTexture);
+            //Con --sim-thread se reserva una cola mas para el hilo de simulacion:
+            if(!jobs.init(workerCount, simThread ? 1 : 0)) {
+                quit = true;
+            }
+
+            //Simulacion a paso fijo: el tiempo real se acumula y se gasta en ticks
+            //de 1/tickRate segundos, asi el resultado no depende de los fps:
+            const float tickStep = 1.f / tickRate;
+            double accumulator = 0;
+            Uint64 lastCounter = SDL_GetPerformanceCounter();
+            //Grabacion o reproduccion de la entrada si se pidio, antes de que el
+            //hilo de simulacion empiece a usarlas:
+            if(!recordPath.empty() && !recorder.open(recordPath)) {
+                quit = true;
+            }
+            if(!replayPath.empty() && !replayer.open(replayPath)) {
+                quit = true;
+            }
+            if(simThread && !quit && !simulation.start(tickStep)) {
+                quit = true;
+            }
 
-            Uint32 inicio = SDL_GetTicks();
+            //Entrada leida en este frame, se aplica (y se graba) en el siguiente tick:
+            vector<SDL_Event> input;
+            Uint32 tick = 0;
+
+            //Contador de frames y tiempo para el modo headless:
+            int frame = 0;
+            Uint64 startCounter = SDL_GetPerformanceCounter();
             while(!quit) {
+                if(headless && !replayer.isOpen()) {
+                    pushScriptedInput(frame);
+                }
                 while(SDL_PollEvent(&e) != 0) {
-                    if(e.type == SDL_QUIT) {
-                        quit = true;
+                    //Al reproducir solo cuenta la entrada grabada, salvo cerrar la ventana:
+                    if(!isRecordable(e.type) || (replayer.isOpen() && e.type != SDL_QUIT)) {
+                        continue;
+                    }
+                    if(simThread) {
+                        simulation.pushInput(e);
+                    } else {
+                        input.push_back(e);
                     }
-                    dot.handleEvent(e);
+                }
+                if(simThread && simulation.hasQuit()) {
+                    quit = true;
                 }
 
-                //Calculamos el tiempo pasado:
-                Uint32 finalTime = SDL_GetTicks();
+                if(simThread) {
+                    //Dibujamos la ultima foto publicada, interpolando con lo que ha
+                    //pasado desde su tick:
+                    simulation.acquireSnapshot();
+                    SimSnapshot &snapshot = simulation.getSnapshot();
+                    double sinceTick = (double)(SDL_GetPerformanceCounter() - snapshot.time) / SDL_GetPerformanceFrequency();
+                    float alpha = min(1.f, max(0.f, (float)(sinceTick / tickStep)));
+                    prepareDots(snapshot.prevX.data(), snapshot.prevY.data(), snapshot.posX.data(), snapshot.posY.data(), snapshot.posX.size(), alpha);
 
-                //Update despues de Handle input y antes del render:
-                dot.move((finalTime - inicio)/1000.f);
+                    SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+                    SDL_RenderClear(renderer);
+                    //Nada del enjambre global: lo esta moviendo el hilo de simulacion:
+                    renderDots(snapshot.sprite, swarmPoints);
+                    snapshot.dot.render(alpha);
+                    SDL_RenderPresent(renderer);
+                } else {
+                    if(headless || (replayFast && replayer.isOpen())) {
+                        //Sin pantalla no se espera al reloj: un tick por frame, lo mas rapido posible:
+                        accumulator += tickStep;
+                    } else {
+                        Uint64 now = SDL_GetPerformanceCounter();
+                        accumulator += (double)(now - lastCounter) / SDL_GetPerformanceFrequency();
+                        accumulator = min(accumulator, MAX_FRAME_TIME);
+                        lastCounter = now;
+                    }
 
-                inicio = finalTime;
+                    //Update despues de Handle input y antes del render:
+                    while(accumulator >= tickStep) {
+                        if(applyTickInput(tick, input, dot)) {
+                            quit = true;
+                        }
+                        dot.move(tickStep);
+                        updateSwarm(tickStep);
+                        accumulator -= tickStep;
+                        tick++;
+                    }
 
-                SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-                SDL_RenderClear(renderer);
-                dot.render();
-                SDL_RenderPresent(renderer);
+                    //Lo que queda en el acumulador es cuanto llevamos del siguiente tick:
+                    float alpha = accumulator / tickStep;
+                    prepareSwarm(alpha);
+
+                    SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+                    SDL_RenderClear(renderer);
+                    renderDots(swarm.sprite, swarmPoints);
+                    dot.render(alpha);
+                    SDL_RenderPresent(renderer);
+                }
+
+                frame++;
+                if(headless && frame >= headlessFrames) {
+                    reportFrames(frame, SDL_GetPerformanceCounter() - startCounter);
+                    if(simThread) {
+                        cout << "ticks de simulacion: " << simulation.getTickCount() << endl;
+                    }
+                    quit = true;
+                }
             }
         }
     }
     close();
     return 0;
 }
+#endif
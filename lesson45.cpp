@@ -1,6 +1,11 @@
 #include <SDL.h>
 #include <SDL_image.h>
 #include <string>
+#include <utility>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+#include <atomic>
 #include <iostream>
 using namespace std;
 
@@ -14,7 +19,15 @@ class Texture {
     public:
         Texture();
         ~Texture();
+
+        //Solo se puede mover: una copia liberaria dos veces la misma SDL_Texture.
+        Texture(const Texture &other) = delete;
+        Texture &operator=(const Texture &other) = delete;
+        Texture(Texture &&other);
+        Texture &operator=(Texture &&other);
         bool loadFromFile(string path);
+        //Se queda con la superficie y la libera:
+        bool loadFromSurface(SDL_Surface *surf);
         void free();
         void render(int x, int y);
         int getWidth();
@@ -35,11 +48,34 @@ Texture::~Texture() {
     free();
 }
 
+//La otra textura se queda vacia, asi su destructor no libera nada:
+Texture::Texture(Texture &&other) : Texture() {
+    swap(texture, other.texture);
+    swap(width, other.width);
+    swap(height, other.height);
+}
+
+Texture &Texture::operator=(Texture &&other) {
+    if(this != &other) {
+        free();
+        swap(texture, other.texture);
+        swap(width, other.width);
+        swap(height, other.height);
+    }
+    return *this;
+}
+
 bool Texture::loadFromFile(string path) {
     SDL_Surface *surf = IMG_Load(path.c_str());
     if(surf == NULL) {
         cout << "No superficie: " << IMG_GetError() << endl;
-    } else {
+        return false;
+    }
+    return loadFromSurface(surf);
+}
+
+bool Texture::loadFromSurface(SDL_Surface *surf) {
+    if(surf != NULL) {
         free();
         texture = SDL_CreateTextureFromSurface(renderer, surf);
         if(texture == NULL) {
@@ -56,6 +92,7 @@ bool Texture::loadFromFile(string path) {
 void Texture::free() {
     if(texture != NULL) {
         SDL_DestroyTexture(texture);
+        texture = NULL;
         width = 0;
         height = 0;
     }
@@ -76,6 +113,436 @@ int Texture::getHeight() {
 
 Texture splashTexture;
 
+//Cola lock-free acotada de varios productores y un consumidor. Cada celda
+//lleva un numero de secuencia que dice si esta libre para el productor que
+//va por esa vuelta o lista para el consumidor, asi los productores solo se
+//reparten la posicion con un compare-exchange y nadie se bloquea:
+template<typename T>
+class MPSCQueue {
+    public:
+        //La capacidad tiene que ser potencia de dos:
+        MPSCQueue(unsigned int capacity);
+
+        //Desde cualquier hilo; si esta llena devuelve false y no toca el elemento:
+        bool push(T &&item);
+        //Solo desde el consumidor:
+        bool pop(T &item);
+    private:
+        struct Cell {
+            std::atomic<Uint32> sequence;
+            T item;
+        };
+
+        std::vector<Cell> cells;
+        Uint32 mask;
+        //Cada indice en su linea de cache para que los hilos no se pisen:
+        alignas(64) std::atomic<Uint32> head{0};
+        alignas(64) Uint32 tail = 0;
+};
+
+template<typename T>
+MPSCQueue<T>::MPSCQueue(unsigned int capacity) : cells(capacity) {
+    //Con otra capacidad la mascara se saltaria celdas:
+    SDL_assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    mask = capacity - 1;
+    for(unsigned int i = 0; i < capacity; i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<typename T>
+bool MPSCQueue<T>::push(T &&item) {
+    Cell *cell;
+    Uint32 position = head.load(std::memory_order_relaxed);
+    while(true) {
+        cell = &cells[position & mask];
+        Sint32 difference = (Sint32)(cell->sequence.load(std::memory_order_acquire) - position);
+        if(difference == 0) {
+            //La celda esta libre en esta vuelta: la reservamos si nadie se adelanta:
+            if(head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if(difference < 0) {
+            //El consumidor aun no ha sacado lo de la vuelta anterior:
+            return false;
+        } else {
+            position = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->item = std::move(item);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool MPSCQueue<T>::pop(T &item) {
+    Cell &cell = cells[tail & mask];
+    if((Sint32)(cell.sequence.load(std::memory_order_acquire) - (tail + 1)) < 0) {
+        return false;
+    }
+
+    item = std::move(cell.item);
+    //Libera la celda para los productores de la siguiente vuelta:
+    cell.sequence.store(tail + mask + 1, std::memory_order_release);
+    tail++;
+    return true;
+}
+
+//Puente hacia el bucle principal: el hilo de temporizadores de SDL, los hilos
+//de carga o el callback de audio dejan aqui trabajo que toca el renderer o el
+//estado del juego, y el bucle principal lo ejecuta una vez por frame:
+const int MAIN_THREAD_TASKS = 1024;
+MPSCQueue<std::function<void()>> mainThreadTasks(MAIN_THREAD_TASKS);
+
+//Si la cola esta llena la tarea se queda en manos de quien llama para reintentar:
+bool postToMainThread(std::function<void()> &&task) {
+    return mainThreadTasks.push(std::move(task));
+}
+
+//Solo desde el hilo principal. Como mucho una cola entera por frame, para que
+//un productor muy rapido no nos deje sin salir de aqui:
+int runMainThreadTasks() {
+    std::function<void()> task;
+    int count = 0;
+    while(count < MAIN_THREAD_TASKS && mainThreadTasks.pop(task)) {
+        task();
+        task = nullptr;
+        count++;
+    }
+    return count;
+}
+
+//Identificador de un temporizador. La generacion cambia cada vez que se
+//reutiliza su hueco, asi cancelar uno ya terminado no afecta a otro:
+struct TimerId {
+    int index;
+    Uint32 generation;
+};
+
+//Rueda de temporizadores jerarquica movida por el reloj del bucle principal.
+//El primer nivel tiene un hueco por milisegundo de los proximos 256 y cada
+//nivel de arriba cubre 64 veces mas con huecos 64 veces mas anchos. Meter y
+//cancelar es O(1) (listas enlazadas por indice) y al avanzar los de un hueco
+//vencen todos juntos; los de niveles altos bajan de nivel al ir llegando:
+class TimerWheel {
+    public:
+        TimerWheel();
+
+        //Empieza a contar desde el tiempo dado (ms de SDL_GetTicks):
+        void start(Uint32 now);
+
+        //Programa callback dentro de delay ms; con interval > 0 se repite:
+        TimerId schedule(Uint32 delay, std::function<void()> callback, Uint32 interval = 0);
+        //Devuelve false si ya habia vencido o se habia cancelado:
+        bool cancel(TimerId id);
+
+        //Avanza hasta now y ejecuta en este hilo lo que venza, devuelve cuantos:
+        int advance(Uint32 now);
+        //Igual pero deja los callbacks vencidos en expired para lanzarlos en otro
+        //sitio (por ejemplo repartidos en un sistema de trabajos). Los que se
+        //repiten se copian, el de advance(now) los llama sin sacarlos:
+        int advance(Uint32 now, std::vector<std::function<void()>> &expired);
+
+        int getActiveCount();
+
+    private:
+        static const int ROOT_BITS = 8;
+        static const int LEVEL_BITS = 6;
+        static const int ROOT_SLOTS = 1 << ROOT_BITS;
+        static const int LEVEL_SLOTS = 1 << LEVEL_BITS;
+        static const int LEVELS = 4;
+        static const int SLOT_COUNT = ROOT_SLOTS + LEVELS * LEVEL_SLOTS;
+        //Estados de un nodo que no esta en ningun hueco:
+        static const int UNLINKED = -1;
+        static const int EXPIRED = -2;
+
+        struct TimerNode {
+            std::function<void()> callback;
+            Uint64 expires;
+            Uint32 interval;
+            Uint32 generation;
+            int slot;
+            int prev;
+            int next;
+        };
+
+        int allocate();
+        void release(int index);
+        void link(int index);
+        void unlink(int index);
+        //Baja los temporizadores de un hueco de nivel alto a los de abajo:
+        void cascade(int level, int slot);
+        //Recorre el tiempo hasta now y apunta los vencidos en fired:
+        void collect(Uint32 now);
+        //Nivel de un hueco: 0 el primero, 1..LEVELS los de arriba:
+        int levelOf(int slot);
+
+        std::vector<TimerNode> nodes;
+        std::vector<int> freeNodes;
+        int heads[SLOT_COUNT];
+        //Temporizadores en cada nivel, para saltar los tramos vacios:
+        int levelCounts[LEVELS + 1];
+        //Siguiente milisegundo por procesar y ultimo tiempo recibido:
+        Uint64 current;
+        Uint32 lastNow;
+        int active;
+        std::vector<TimerId> fired;
+};
+
+TimerWheel::TimerWheel() {
+    for(int i = 0; i < SLOT_COUNT; i++) {
+        heads[i] = -1;
+    }
+    for(int i = 0; i <= LEVELS; i++) {
+        levelCounts[i] = 0;
+    }
+    current = 1;
+    lastNow = 0;
+    active = 0;
+}
+
+void TimerWheel::start(Uint32 now) {
+    lastNow = now;
+}
+
+int TimerWheel::allocate() {
+    if(!freeNodes.empty()) {
+        int index = freeNodes.back();
+        freeNodes.pop_back();
+        return index;
+    }
+    TimerNode node;
+    node.generation = 0;
+    node.slot = UNLINKED;
+    nodes.push_back(node);
+    return nodes.size() - 1;
+}
+
+void TimerWheel::release(int index) {
+    nodes[index].callback = nullptr;
+    nodes[index].slot = UNLINKED;
+    nodes[index].generation++;
+    freeNodes.push_back(index);
+    active--;
+}
+
+int TimerWheel::levelOf(int slot) {
+    if(slot < ROOT_SLOTS) {
+        return 0;
+    }
+    return 1 + (slot - ROOT_SLOTS) / LEVEL_SLOTS;
+}
+
+void TimerWheel::link(int index) {
+    TimerNode &node = nodes[index];
+    Uint64 expires = node.expires;
+    //Los que ya deberian haber vencido van al siguiente milisegundo:
+    if(expires < current) {
+        expires = current;
+    }
+    Uint64 delta = expires - current;
+
+    int slot;
+    if(delta < ROOT_SLOTS) {
+        slot = expires & (ROOT_SLOTS - 1);
+    } else {
+        int level = 0;
+        while(level < LEVELS - 1 && delta >= (Uint64)1 << (ROOT_BITS + (level + 1) * LEVEL_BITS)) {
+            level++;
+        }
+        //Mas alla del ultimo nivel se queda en su ultimo hueco y va bajando:
+        if(delta >= (Uint64)1 << (ROOT_BITS + LEVELS * LEVEL_BITS)) {
+            expires = current + ((Uint64)1 << (ROOT_BITS + LEVELS * LEVEL_BITS)) - 1;
+        }
+        int shift = ROOT_BITS + level * LEVEL_BITS;
+        slot = ROOT_SLOTS + level * LEVEL_SLOTS + ((expires >> shift) & (LEVEL_SLOTS - 1));
+    }
+
+    node.slot = slot;
+    levelCounts[levelOf(slot)]++;
+    node.prev = -1;
+    node.next = heads[slot];
+    if(heads[slot] != -1) {
+        nodes[heads[slot]].prev = index;
+    }
+    heads[slot] = index;
+}
+
+void TimerWheel::unlink(int index) {
+    TimerNode &node = nodes[index];
+    if(node.prev != -1) {
+        nodes[node.prev].next = node.next;
+    } else {
+        heads[node.slot] = node.next;
+    }
+    if(node.next != -1) {
+        nodes[node.next].prev = node.prev;
+    }
+    levelCounts[levelOf(node.slot)]--;
+    node.slot = UNLINKED;
+}
+
+TimerId TimerWheel::schedule(Uint32 delay, std::function<void()> callback, Uint32 interval) {
+    int index = allocate();
+    TimerNode &node = nodes[index];
+    node.callback = std::move(callback);
+    //current - 1 es el ultimo milisegundo ya procesado:
+    node.expires = current - 1 + delay;
+    node.interval = interval;
+    link(index);
+    active++;
+
+    TimerId id = {index, node.generation};
+    return id;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    if(id.index < 0 || id.index >= (int)nodes.size() || nodes[id.index].generation != id.generation) {
+        return false;
+    }
+
+    TimerNode &node = nodes[id.index];
+    if(node.slot >= 0) {
+        unlink(id.index);
+    } else if(node.slot != EXPIRED) {
+        return false;
+    }
+    release(id.index);
+    return true;
+}
+
+void TimerWheel::cascade(int level, int slot) {
+    int head = ROOT_SLOTS + level * LEVEL_SLOTS + slot;
+    int index = heads[head];
+    heads[head] = -1;
+    while(index != -1) {
+        int next = nodes[index].next;
+        levelCounts[level + 1]--;
+        link(index);
+        index = next;
+    }
+}
+
+void TimerWheel::collect(Uint32 now) {
+    //Restamos en Uint32 para que funcione aunque SDL_GetTicks de la vuelta:
+    Uint32 elapsed = now - lastNow;
+    lastNow = now;
+    Uint64 target = current - 1 + elapsed;
+
+    fired.clear();
+    while(current <= target) {
+        int slot = current & (ROOT_SLOTS - 1);
+
+        //Al dar la vuelta al primer nivel bajamos el siguiente hueco del de arriba,
+        //y asi hacia arriba mientras tambien den la vuelta:
+        if(slot == 0) {
+            for(int level = 0; level < LEVELS; level++) {
+                int levelSlot = (current >> (ROOT_BITS + level * LEVEL_BITS)) & (LEVEL_SLOTS - 1);
+                cascade(level, levelSlot);
+                if(levelSlot != 0) {
+                    break;
+                }
+            }
+        }
+
+        //Todo el hueco vence de golpe:
+        int index = heads[slot];
+        heads[slot] = -1;
+        while(index != -1) {
+            int next = nodes[index].next;
+            nodes[index].slot = EXPIRED;
+            levelCounts[0]--;
+            TimerId id = {index, nodes[index].generation};
+            fired.push_back(id);
+            index = next;
+        }
+        current++;
+
+        //Tras un paron largo no recorremos milisegundo a milisegundo: si el primer
+        //nivel esta vacio saltamos a la siguiente bajada de un nivel con algo, y
+        //si no, al siguiente hueco ocupado de esta vuelta:
+        if(levelCounts[0] == 0) {
+            int level = 0;
+            while(level < LEVELS && levelCounts[level + 1] == 0) {
+                level++;
+            }
+            if(level == LEVELS) {
+                current = target + 1;
+            } else {
+                Uint64 step = (Uint64)1 << (ROOT_BITS + level * LEVEL_BITS);
+                Uint64 next = (current + step - 1) & ~(step - 1);
+                current = next < target + 1 ? next : target + 1;
+            }
+        } else {
+            while(current <= target && (current & (ROOT_SLOTS - 1)) != 0 && heads[current & (ROOT_SLOTS - 1)] == -1) {
+                current++;
+            }
+        }
+    }
+}
+
+int TimerWheel::advance(Uint32 now, std::vector<std::function<void()>> &expired) {
+    collect(now);
+
+    int count = 0;
+    for(unsigned int i = 0; i < fired.size(); i++) {
+        TimerNode &node = nodes[fired[i].index];
+        //Puede haberse cancelado mientras esperaba en la tanda:
+        if(node.generation != fired[i].generation || node.slot != EXPIRED) {
+            continue;
+        }
+
+        if(node.interval > 0) {
+            expired.push_back(node.callback);
+            node.expires += node.interval;
+            link(fired[i].index);
+        } else {
+            expired.push_back(std::move(node.callback));
+            release(fired[i].index);
+        }
+        count++;
+    }
+    return count;
+}
+
+int TimerWheel::advance(Uint32 now) {
+    collect(now);
+
+    int count = 0;
+    for(unsigned int i = 0; i < fired.size(); i++) {
+        int index = fired[i].index;
+        //Puede haberse cancelado, incluso desde un callback de esta misma tanda:
+        if(nodes[index].generation != fired[i].generation || nodes[index].slot != EXPIRED) {
+            continue;
+        }
+
+        //El callback se saca del nodo solo mientras corre, porque si programa
+        //otros temporizadores el vector de nodos puede moverse:
+        std::function<void()> callback = std::move(nodes[index].callback);
+        if(nodes[index].interval > 0) {
+            nodes[index].expires += nodes[index].interval;
+            link(index);
+            callback();
+            //Si no se ha cancelado desde dentro vuelve a su nodo sin copiarlo:
+            if(nodes[index].generation == fired[i].generation) {
+                nodes[index].callback = std::move(callback);
+            }
+        } else {
+            release(index);
+            callback();
+        }
+        count++;
+    }
+    return count;
+}
+
+int TimerWheel::getActiveCount() {
+    return active;
+}
+
+TimerWheel timers;
+
 bool init() {
     bool success = true;
 
@@ -105,17 +572,58 @@ bool init() {
     return success;
 }
 
+//La imagen se lee en un hilo de carga; la textura se crea en el hilo principal
+//porque el renderer no se puede usar desde otros hilos:
+SDL_Thread *loaderThread = NULL;
+
+int loadSplash(void *) {
+    SDL_Surface *surf = IMG_Load("assets/lesson45/splash.png");
+    if(surf == NULL) {
+        cout << "No superficie: " << IMG_GetError() << endl;
+        return 1;
+    }
+
+    std::function<void()> task = [surf] {
+        splashTexture.loadFromSurface(surf);
+    };
+    while(!postToMainThread(std::move(task))) {
+        SDL_Delay(1);
+    }
+    return 0;
+}
+
 bool loadMedia() {
     bool success = true;
 
-    if(!splashTexture.loadFromFile("assets/lesson45/splash.png")) {
+    loaderThread = SDL_CreateThread(loadSplash, "loader", NULL);
+    if(loaderThread == NULL) {
+        cout << SDL_GetError() << endl;
         success = false;
     }
 
     return success;
 }
 
+//Corre en el hilo de temporizadores de SDL: no toca nada, solo deja el
+//cambio de titulo para el hilo principal. Si la cola esta llena se pierde
+//este segundo y ya llegara el siguiente:
+Uint32 heartbeat(Uint32 intervalo, void *) {
+    static int seconds = 0;
+    seconds++;
+    int elapsed = seconds;
+    postToMainThread([elapsed] {
+        SDL_SetWindowTitle(w, ("SDL Timer - " + std::to_string(elapsed) + " s").c_str());
+    });
+    return intervalo;
+}
+
 void close() {
+    //Lo que quede en la cola puede tener superficies del hilo de carga:
+    if(loaderThread != NULL) {
+        SDL_WaitThread(loaderThread, NULL);
+    }
+    runMainThreadTasks();
+
     splashTexture.free();
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(w);
@@ -123,20 +631,90 @@ void close() {
     SDL_Quit();
 }
 
-Uint32 callback(Uint32 intervalo, void *param) {
-    std::string *str = static_cast<std::string*>(param);
-    cout << "Callback llamado con el mensaje: " << *str << endl;
-    delete str;
-    return 0;
+//Microbenchmark: 100k temporizadores activos, como cooldowns y animaciones
+//de una partida grande. Mide meter, cancelar y avanzar frame a frame:
+const int BENCH_TIMERS = 100000;
+const Uint32 BENCH_SPAN = 60000;
+const Uint32 BENCH_FRAME = 16;
+const int BENCH_FRAMES = 3600;
+
+double ticksToMicros(Uint64 ticks) {
+    return (double)ticks / SDL_GetPerformanceFrequency() * 1000000.0;
+}
+
+void benchmarkTimers() {
+    TimerWheel wheel;
+    wheel.start(0);
+    std::vector<TimerId> ids(BENCH_TIMERS);
+    int fired = 0;
+    srand(45);
+
+    //Cada uno que vence se vuelve a programar para mantener siempre 100k activos:
+    std::function<void()> rearm;
+    rearm = [&wheel, &fired, &rearm] {
+        fired++;
+        wheel.schedule(rand() % BENCH_SPAN + 1, rearm);
+    };
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for(int i = 0; i < BENCH_TIMERS; i++) {
+        //Uno de cada diez se repite solo:
+        if(i % 10 == 0) {
+            ids[i] = wheel.schedule(rand() % BENCH_SPAN + 1, [&fired] { fired++; }, rand() % 1000 + BENCH_FRAME);
+        } else {
+            ids[i] = wheel.schedule(rand() % BENCH_SPAN + 1, rearm);
+        }
+    }
+    double insertTime = ticksToMicros(SDL_GetPerformanceCounter() - start) * 1000.0 / BENCH_TIMERS;
+
+    start = SDL_GetPerformanceCounter();
+    int cancelled = 0;
+    for(int i = 1; i < BENCH_TIMERS; i += 2) {
+        if(wheel.cancel(ids[i])) {
+            cancelled++;
+        }
+    }
+    double cancelTime = ticksToMicros(SDL_GetPerformanceCounter() - start) * 1000.0 / cancelled;
+    for(int i = 1; i < BENCH_TIMERS; i += 2) {
+        ids[i] = wheel.schedule(rand() % BENCH_SPAN + 1, rearm);
+    }
+
+    Uint64 worst = 0;
+    start = SDL_GetPerformanceCounter();
+    for(int frame = 1; frame <= BENCH_FRAMES; frame++) {
+        Uint64 frameStart = SDL_GetPerformanceCounter();
+        wheel.advance(frame * BENCH_FRAME);
+        Uint64 frameTime = SDL_GetPerformanceCounter() - frameStart;
+        if(frameTime > worst) {
+            worst = frameTime;
+        }
+    }
+    double advanceTime = ticksToMicros(SDL_GetPerformanceCounter() - start) / BENCH_FRAMES;
+
+    cout << "temporizadores activos: " << wheel.getActiveCount() << endl;
+    cout << "schedule: " << insertTime << " ns, cancel: " << cancelTime << " ns" << endl;
+    cout << "advance por frame: media " << advanceTime << " us, peor " << ticksToMicros(worst) << " us, vencidos " << fired << " en " << BENCH_FRAMES << " frames" << endl;
 }
 
 int main(int argc, char* args[]) {
+    //Con --bench-timers solo se mide la rueda, sin abrir ventana:
+    if(argc > 1 && std::string(args[1]) == "--bench-timers") {
+        benchmarkTimers();
+        return 0;
+    }
+
     if(init()) {
         if(loadMedia()) {
             bool quit = false;
             SDL_Event e;
             std::string helloCallback = "Se ha esperado 3 segundos!";
-            SDL_TimerID timerId = SDL_AddTimer(3*1000, callback, &helloCallback);
+            //El callback se ejecuta en este hilo al avanzar la rueda, y se
+            //queda con su copia del mensaje:
+            timers.start(SDL_GetTicks());
+            TimerId timerId = timers.schedule(3*1000, [helloCallback] {
+                cout << "Callback llamado con el mensaje: " << helloCallback << endl;
+            });
+            SDL_TimerID heartbeatId = SDL_AddTimer(1000, heartbeat, NULL);
 
             while(!quit) {
                 while(SDL_PollEvent(&e) != 0) {
@@ -145,12 +723,16 @@ int main(int argc, char* args[]) {
                     }
                 }
 
+                runMainThreadTasks();
+                timers.advance(SDL_GetTicks());
+
                 SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
                 SDL_RenderClear(renderer);
                 splashTexture.render(0, 0);
                 SDL_RenderPresent(renderer);
             }
-            SDL_RemoveTimer(timerId);
+            timers.cancel(timerId);
+            SDL_RemoveTimer(heartbeatId);
         }
     }
     close();